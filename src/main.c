@@ -7,12 +7,43 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <pd_api.h>
 
 // TYPES
-enum NodeType { Dead, Strong, Weak };
+enum NodeType { Dead, Strong, Weak, NodeTypeCount };
+enum VoiceEngine { SynthEngine, SampleEngine };
+enum NodeTimer { TouchTimer, PulseTimer, DeathTimer, NodeTimerCount };
+enum AudioCommandType { AudioVoiceClaim, AudioVoiceRelease, AudioNoteOn, AudioVolume, AudioEnvelope, AudioRateClass };
+// the main loop moves capture to WavStopping, the tap acknowledges with WavStopped on its next block
+enum WavState { WavIdle, WavCapturing, WavStopping, WavStopped };
 struct Volume { float l; float r; };
+// everything that differs between node types, one row per type in NODE_TYPE_INFO
+struct NodeTypeInfo
+{
+    SoundWaveform waveform;
+    LFOType modShape;
+    // rendered by the sub-rate generator instead of waveform (MULTIRATE_VOICES)
+    int subRate;
+    // polyphony, at most NODE_MAX_VOICES
+    int voices;
+    // instruments in the type's pool, so how many nodes of the type can be live at once (at most NODE_MAX_POOL)
+    int poolSize;
+    float minAttack;
+    float maxAttack;
+    float minDecay;
+    float maxDecay;
+    float minSustain;
+    float maxSustain;
+    float minRelease;
+    float maxRelease;
+    float minPulseMod;
+    float maxPulseMod;
+    float voiceCost;
+    // animation frames, numbered from 1
+    const char *imageFormat;
+};
 struct PitchSet
 {
     int common[4];
@@ -24,6 +55,38 @@ struct PitchField
 {
     int pitches[12];
 };
+// main loop -> audio context
+struct AudioCommand
+{
+    uint8_t type;
+    uint8_t voice;
+    float value[4];
+};
+// audio context's view of a node's voice
+struct AudioVoice
+{
+    int claimed;
+    float note;
+    float velocity;
+    float len;
+    float attack;
+    float decay;
+    float sustain;
+    float release;
+    float volume[2];
+    uint32_t noteStart;
+    float peak;
+};
+// a sine voice computed every factor'th sample & interpolated back up to full rate
+struct SubRateVoice
+{
+    uint32_t phase;
+    int factor;
+    int shift;
+    int step;
+    int32_t previous;
+    int32_t current;
+};
 
 // DECLARED METHODS
 static int update(void* userdata);
@@ -35,24 +98,6 @@ static int update(void* userdata);
 
 #define MAX_NODES 12
 
-#define NODE_MIN_ATTACK_1 0.01f
-#define NODE_MAX_ATTACK_1 0.2f
-#define NODE_MIN_DECAY_1 0.05f
-#define NODE_MAX_DECAY_1 0.3f
-#define NODE_MIN_SUSTAIN_1 0.06f
-#define NODE_MAX_SUSTAIN_1 0.3f
-#define NODE_MIN_RELEASE_1 0.2f
-#define NODE_MAX_RELEASE_1 1.0f
-
-#define NODE_MIN_ATTACK_2 0.2f
-#define NODE_MAX_ATTACK_2 1.0f
-#define NODE_MIN_DECAY_2 0.5f
-#define NODE_MAX_DECAY_2 1.0f
-#define NODE_MIN_SUSTAIN_2 0.1f
-#define NODE_MAX_SUSTAIN_2 0.5f
-#define NODE_MIN_RELEASE_2 0.5f
-#define NODE_MAX_RELEASE_2 4.0f
-
 #define MIN_FREQ_MOD_RATE 0.001f
 #define MAX_FREQ_MOD_RATE 0.3f
 #define MIN_FREQ_MOD_DEPTH 0.0f
@@ -79,8 +124,6 @@ static int update(void* userdata);
 #define MIN_TIME_VELOCITY 0.5f
 #define MAX_TIME_VELOCITY 2.5f
 
-// of 10
-#define RARE_PITCH_ODDS 2
 
 #define MIDI_START 21
 #define NODE_MIN_OCTAVE 0
@@ -93,24 +136,234 @@ static int update(void* userdata);
 
 #define GRID_SCALE 0.01f
 
+// audio load governor
+// voice cost is in rough "sine voice" units; the budget is what the device sustains without underruns
+#define STRONG_VOICE_COST 2.0f
+#define WEAK_VOICE_COST 1.0f
+#define MOD_VOICE_COST 1.0f
+#define AUDIO_BUDGET 20.0f
+#define GOVERNOR_HIGH_LOAD 0.9f
+#define GOVERNOR_LOW_LOAD 0.6f
+#define MIN_NODE_CAP 4
+#define MIN_LIFETIME_SCALE 0.25f
+
+// main loop -> audio command ring, must be a power of 2
+#define AUDIO_QUEUE_SIZE 256
+// flood the ring from both ends on startup (before the audio side is attached) & check order & drops
+// (a single threaded self-test, not a concurrent producer/consumer stress test)
+#define AUDIO_RING_TEST 0
+#define AUDIO_RING_TEST_ROUNDS 10000
+
+// per audio block decay of the held voice peaks (~0.5 s to fall away at 256 sample blocks)
+#define PEAK_DECAY 0.99f
+// node sprites grow with their voice's level, through NODE_SIZES pre-scaled copies of every frame
+#define NODE_SIZES 3
+#define NODE_MIN_SCALE 0.75f
+#define NODE_MAX_SCALE 1.25f
+
+// spatial maps: positional parameters precomputed per 2^SPATIAL_CELL_SHIFT pixel cell
+// (positions run 0..LCD_COLUMNS/LCD_ROWS inclusive, hence the extra cell)
+#define SPATIAL_CELL_SHIFT 2
+#define SPATIAL_COLS ((LCD_COLUMNS >> SPATIAL_CELL_SHIFT) + 1)
+#define SPATIAL_ROWS ((LCD_ROWS >> SPATIAL_CELL_SHIFT) + 1)
+
+// ripples: one expanding ring per pulse, XORed straight into the frame
+#define RIPPLE_MAX 64
+#define RIPPLE_MAX_PER_FRAME 32
+#define RIPPLE_MAX_RADIUS 48
+// pixels per second of virtual time
+#define RIPPLE_SPEED 40
+
+// water: a wave field at 4 px cells behind everything, splashed by pulses & dithered into the frame
+// drawn by a background sprite, so only cells whose shade changed (and what the sprites dirty) redraw
+#define WATER_FIELD 1
+#define WATER_CELL_SHIFT 2
+#define WATER_COLS (LCD_COLUMNS >> WATER_CELL_SHIFT)
+#define WATER_ROWS (LCD_ROWS >> WATER_CELL_SHIFT)
+// higher = waves last longer
+#define WATER_DAMPING 5
+#define WATER_SPLASH 1024
+// wave height >> this = dither level 0..16
+#define WATER_SHADE_SHIFT 5
+// time the water step & dither on startup
+#define WATER_BENCH 0
+#define WATER_BENCH_RUNS 100
+
+// voices quieter than this (left + right) with an idle envelope are taken off CHANNEL
+#define AUDIBLE_THRESHOLD 0.02f
+#define IDLE_ENVELOPE 0.001f
+
+// weak (sine) nodes render through our own generator at a rate set by octave
+// octaves up to MULTIRATE_QUARTER_OCTAVE at 1/4 rate, up to MULTIRATE_HALF_OCTAVE at 1/2
+#define MULTIRATE_VOICES 1
+#define MULTIRATE_QUARTER_OCTAVE 1
+#define MULTIRATE_HALF_OCTAVE 3
+#define SINE_TABLE_BITS 10
+
+// low power engine: pre-rendered looping samples per node type, octave & modulation intensity
+// picked from the system menu, applies to new nodes
+#define SAMPLE_VOICES 1
+#define SAMPLE_OCTAVE_VARIANTS 3
+#define SAMPLE_INTENSITY_VARIANTS 2
+#define SAMPLE_LOOP_SECONDS 0.5f
+// sample synths play a sample at its own pitch for this note
+#define SAMPLE_ROOT_NOTE 60
+#define SAMPLE_VOICE_COST 0.5f
+
+// midi export: every note into a standard midi file, a channel per node ID (skipping GM percussion), toggled from the system menu
+// events collect in RAM & go out in MIDI_FLUSH_SIZE writes from the main loop
+#define MIDI_EXPORT 1
+#define MIDI_BUFFER_SIZE 4096
+#define MIDI_FLUSH_SIZE 2048
+// at the default 120 bpm
+#define MIDI_TICKS_PER_QUARTER 480
+#define MIDI_TICKS_PER_SECOND (MIDI_TICKS_PER_QUARTER * 2)
+
+// wav capture: a tap at the end of CHANNEL fills one of two buffers while the main loop writes the other
+// toggled from the system menu, the audio side never touches the file or allocates
+#define WAV_CAPTURE 1
+#define WAV_BUFFER_FRAMES 8192
+// stop on terminate waits this long for the tap before deciding the audio isn't running
+#define WAV_STOP_TIMEOUT_MS 100
+
+// a take starts from its seed & starting pitch field set: the soak, sweep & bench step a fixed virtual clock,
+// so there the same seed replays the same run, the game steps once a frame by however far the audio clock
+// moved, so frame timing & input shape what a take does from there
+// (a resumed session replaces both with its saved random stream & pitch field, see SESSION_RESUME)
+#define TAKE_SEED 1
+#define TAKE_PITCH_FIELD 0
+
+// rewind: crank back past the slowest speed to scrub back through snapshots taken every control tick
+// REWIND_BUDGET bytes of snapshots (offsets are 16 bit, so at most 64 KB), a keyframe every REWIND_KEYFRAME_TICKS
+// (off in the parameter sweep, which keeps no history)
+#define REWIND (1 && !PARAM_SWEEP)
+#define REWIND_BUDGET (48 * 1024)
+#define REWIND_ENTRIES 2048
+#define REWIND_KEYFRAME_TICKS 60
+#define REWIND_DEGREES_PER_TICK 3.0f
+// frames without crank movement before play carries on from the rewound point
+#define REWIND_RESUME_FRAMES 15
+
+// session resume: the field is saved on terminate & lock and picked up again on launch
+// the file is written field by field, little endian, so it doesn't depend on struct padding
+// bump SESSION_VERSION whenever the fields written by encodeSession change
+// (off in the test & bench harnesses, which mustn't pick up or overwrite a player's field)
+#define SESSION_RESUME (1 && !SOAK_TEST && !PARAM_SWEEP && !BENCH_SUITE)
+#define SESSION_PATH "session.bin"
+#define SESSION_MAGIC 0x53535052
+#define SESSION_VERSION 2
+// magic, version, size, velocity, player x & y, snapshot header, then every node slot
+#define SESSION_NODE_BYTES 28
+#define SESSION_BYTES (52 + SESSION_NODE_BYTES * MAX_NODES)
+
+// nodes play through an instrument over a small voice set so overlapping notes ring out
+// each type has a pool of NodeTypeInfo.poolSize instruments built up front with NodeTypeInfo.voices synths each,
+// a node takes one when it's made & gives it back when it's freed, a type with none left retires its oldest node first
+#define NODE_MAX_VOICES 3
+#define NODE_MAX_POOL 8
+
+// player sprite turns with the crank through this many cached rotations
+#define PLAYER_ROTATIONS 36
+
+// node touches are spread over this many phase slots per TOUCH_RATE (~frames per touch period)
+#define TOUCH_PHASES 3
+
+// timer wheel: level 0 slots are 2^WHEEL_SLOT_SHIFT samples (~23 ms), level 1 slots span a whole level 0 turn
+#define WHEEL_SLOT_SHIFT 10
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define PITCH_FIELD_TIMER (MAX_NODES * NodeTimerCount)
+#define TIMER_COUNT (PITCH_FIELD_TIMER + 1)
+
+// time the node control batch at a few node counts on startup
+#define BATCH_BENCH 0
+#define BATCH_BENCH_RUNS 1000
+
+// log audio deadline stats to the console once a second
+// the audio control source counts the samples rendered, so a block that missed its deadline shows up as
+// that count falling behind the system's millisecond clock (the sound engine's own clock stalls with the
+// render, so it can't be the reference), & the command ring's depth is tracked as each command is pushed
+// (the render time itself isn't measured: the audio side has no high resolution clock that's safe to read)
+#define AUDIO_STATS 0
+#define AUDIO_BLOCK_SIZE 256
+
+// accelerated soak test: random inputs & SOAK_STEPS_PER_FRAME control steps per frame on a virtual clock
+// (~1000x real time at 30 fps), checking node, sprite & timer bookkeeping as it goes
+// starts just short of where a 32 bit sample clock would wrap
+#define SOAK_TEST 0
+#define SOAK_STEPS_PER_FRAME 1000
+#define SOAK_HOURS 30
+#define SOAK_SPAWN_ODDS 40
+#define SOAK_CRANK_ODDS 20
+
+// control-only parameter sweep: every combination of the SWEEP_* tables for SWEEP_MINUTES of
+// virtual time each, with random spawns & CHANNEL off the sound engine, logging note stats per combination
+#define PARAM_SWEEP 0
+#define SWEEP_STEPS_PER_FRAME 1000
+#define SWEEP_MINUTES 10
+#define SWEEP_SPAWN_ODDS 60
+#define SWEEP_VALUES 3
+
+// log frame time percentiles to the console
+#define FRAME_STATS 0
+#define FRAME_STATS_BINS 64
+#define FRAME_STATS_BIN_MS 0.5f
+#define FRAME_STATS_WINDOW 300
+
+// bench suite: runs each BenchScenario for its frames on a fixed virtual clock step & writes the
+// results to BENCH_RESULTS_PATH, then fails on any metric past BENCH_BASELINE_PATH by BENCH_THRESHOLD
+// (plus the metric's slack), a baseline is a results file from a device run copied into Source/,
+// none is checked in & a missing one fails, so the first run only produces one
+// lines are: scenario frame-ms worst-frame-ms control-ms api-calls/frame
+// (leave the controls alone while it runs)
+#define BENCH_SUITE 0
+#define BENCH_FRAMES 150
+#define BENCH_SOAK_FRAMES 1800
+#define BENCH_SPAWN_ODDS 10
+#define BENCH_STORM_NODES 4
+#define BENCH_CRANK_DEGREES 30.0f
+#define BENCH_PITCH_FIELD_FRAMES 10
+#define BENCH_THRESHOLD 0.1f
+#define BENCH_RESULTS_PATH "bench-results.txt"
+#define BENCH_BASELINE_PATH "bench-baseline.txt"
+
+// api trace: setup & update get a copy of the API whose per-frame calls (API_TRACE_CALLS) go through
+// wrappers counting & timing them, calls per frame are binned by powers of two and written to
+// API_TRACE_PATH every API_TRACE_WINDOW frames
+// (always on with the bench suite, which reports its counts)
+#define API_TRACE (0 || BENCH_SUITE)
+#define API_TRACE_BINS 8
+#define API_TRACE_WINDOW 300
+#define API_TRACE_PATH "api-trace.txt"
+
 // misc
 const PlaydateAPI* PD;
 LCDFont* FONT = NULL;
 const char* ERR;
 const int SLOW_BASE_PULSE = SAMPLE_RATE * 10;
 const int HIGH_BASE_PULSE = SAMPLE_RATE / 15;
-const int NODE_LIFETIME = SAMPLE_RATE * 16;
+static int NODE_LIFETIME = SAMPLE_RATE * 16;
 const int NODE_FADE_BUFFER = SAMPLE_RATE * 4;
 const float CENTER_X = (float)LCD_COLUMNS / 2.0f;
 const float CENTER_Y = (float)LCD_ROWS / 2.0f;
-static uint32_t CURRENT_TIME;
+// virtual sample clock, 64 bit so it never wraps (32 bits of samples wrap after ~27 hours)
+static uint64_t CURRENT_TIME;
+static float CURRENT_TIME_REMAINDER;
 static uint32_t LAST_REAL_TIME;
 float TIME_VELOCITY;
-static uint32_t NEXT_TOUCH;
+static uint64_t TOUCH_EPOCH;
 const int TOUCH_RATE = SAMPLE_RATE / 10;
+// the take's own random stream, nothing outside the simulation draws from it
+static uint32_t TAKE_RNG = TAKE_SEED;
 static float MAX_DISTANCE_FROM_CENTER;
 static float INVERSE_MAX_DIST_FROM_CENTER;
 static float INVERSE_FADE_BUFFER;
+static int NODE_CAP;
+static float LIFETIME_SCALE;
+static float AUDIO_LOAD;
+static uint64_t NEXT_GOVERN;
+const int GOVERN_RATE = SAMPLE_RATE;
 const struct PitchField PITCH_FIELD_SET[4] =
 {
     {{ 0, 0, 2, 5, 7, 7, 12, 12, 14, 17, 19, 23 }},
@@ -127,11 +380,30 @@ const struct PitchSet PITCH_SETS[4] =
     { {5, 6, 7}, 3, {8}, 1 },
     { {7, 10}, 2, {9, 11}, 2 }
 };
-static uint32_t NEXT_PITCH_FIELD_CHANGE;
-const int CHANGE_PITCH_FIELD_RATE = SAMPLE_RATE * 30;
+static int CHANGE_PITCH_FIELD_RATE = SAMPLE_RATE * 30;
+// of 10
+static int RARE_PITCH_ODDS = 2;
+static float PULSE_MOD_SCALE = 1.0f;
 const int GRID_HEIGHT = (float)LCD_ROWS * GRID_SCALE;
 const int GRID_WIDTH = (float)LCD_COLUMNS * GRID_SCALE;
 static int GRID_POINT_NODE_COUNT[(int)((float)LCD_ROWS * GRID_SCALE)][(int)((float)LCD_COLUMNS * GRID_SCALE)];
+const struct NodeTypeInfo NODE_TYPE_INFO[NodeTypeCount] =
+{
+    [Strong] = {
+        .waveform = kWaveformSawtooth, .modShape = kLFOTypeTriangle, .subRate = 0, .voices = 2, .poolSize = 6,
+        .minAttack = 0.01f, .maxAttack = 0.2f, .minDecay = 0.05f, .maxDecay = 0.3f,
+        .minSustain = 0.06f, .maxSustain = 0.3f, .minRelease = 0.2f, .maxRelease = 1.0f,
+        .minPulseMod = NODE_MIN_PULSE_MOD, .maxPulseMod = NODE_MAX_PULSE_MOD, .voiceCost = STRONG_VOICE_COST,
+        .imageFormat = "images/Node_1/type_1_%d"
+    },
+    [Weak] = {
+        .waveform = kWaveformSine, .modShape = kLFOTypeSine, .subRate = 1, .voices = 3, .poolSize = 8,
+        .minAttack = 0.2f, .maxAttack = 1.0f, .minDecay = 0.5f, .maxDecay = 1.0f,
+        .minSustain = 0.1f, .maxSustain = 0.5f, .minRelease = 0.5f, .maxRelease = 4.0f,
+        .minPulseMod = NODE_MIN_PULSE_MOD, .maxPulseMod = NODE_MAX_PULSE_MOD, .voiceCost = WEAK_VOICE_COST,
+        .imageFormat = "images/Node_2/type_2_%d"
+    }
+};
 
 // global sound
 float BASE_PULSE;
@@ -153,33 +425,502 @@ int32_t NODE_NEED_TOUCH[MAX_NODES];
 int NODE_X[MAX_NODES];
 int NODE_Y[MAX_NODES];
 enum NodeType NODE_TYPE[MAX_NODES];
-int NODE_DEATH_TIME[MAX_NODES];
+uint64_t NODE_DEATH_TIME[MAX_NODES];
+int NODE_LIFESPAN[MAX_NODES];
 int NODE_GRID_X[MAX_NODES];
 int NODE_GRID_Y[MAX_NODES];
-LCDSprite *NODE_1_SPRITE_MASTER;
-LCDSprite *NODE_2_SPRITE_MASTER;
+LCDSprite *NODE_SPRITE_MASTER[NodeTypeCount];
 LCDSprite *NODE_SPRITE[MAX_NODES];
 int NODE_ANIM_STATE[MAX_NODES];
+int NODE_ANIM_SIZE[MAX_NODES];
 
 // node management
 int LAST_FREED_NODE;
 int LIVE_NODE_COUNT = 0;
 
 // node sound
-struct PDSynth *NODE_SYNTH[MAX_NODES];
-uint32_t NODE_NEXT_PULSE[MAX_NODES];
+PDSynthInstrument *NODE_INSTRUMENT[MAX_NODES];
+// preallocated per type, free entries stacked in TYPE_POOL_FREE
+PDSynthInstrument *TYPE_INSTRUMENT[NodeTypeCount][NODE_MAX_POOL];
+PDSynth *TYPE_VOICE[NodeTypeCount][NODE_MAX_POOL][NODE_MAX_VOICES];
+PDSynthLFO *TYPE_FREQ_MOD[NodeTypeCount][NODE_MAX_POOL][NODE_MAX_VOICES];
+PDSynthLFO *TYPE_AMP_MOD[NodeTypeCount][NODE_MAX_POOL][NODE_MAX_VOICES];
+int TYPE_POOL_FREE[NodeTypeCount][NODE_MAX_POOL];
+int TYPE_POOL_FREE_COUNT[NodeTypeCount];
+// which pool entry a live node holds
+int NODE_POOL_ENTRY[MAX_NODES];
+int ACTIVE_VOICES;
+int PEAK_ACTIVE_VOICES;
+enum VoiceEngine NODE_ENGINE[MAX_NODES];
+// off CHANNEL because it can't be heard
+int NODE_CULLED[MAX_NODES];
+int CULLED_NODE_COUNT;
+float NODE_RELEASE[MAX_NODES];
+// until the last note's release is over
+uint64_t NODE_SOUNDING_UNTIL[MAX_NODES];
+uint64_t NODE_NEXT_PULSE[MAX_NODES];
 float NODE_PULSE_MOD[MAX_NODES];
 struct Volume NODE_FADE_VOL[MAX_NODES];
 float NODE_LEN[MAX_NODES];
 int NODE_PITCH_SET[MAX_NODES];
 // 0 to 6
 int NODE_OCTAVE[MAX_NODES];
+float NODE_COST[MAX_NODES];
+
+// spatial maps
+// swap SPATIAL_MAP to give a scene a different sonic geography
+struct SpatialMap
+{
+    // 0 = edge, 255 = center
+    uint8_t centerCloseness[SPATIAL_ROWS][SPATIAL_COLS];
+    uint8_t quadrant[SPATIAL_ROWS][SPATIAL_COLS];
+    uint8_t octave[SPATIAL_ROWS];
+    // 0 = right, 255 = left
+    uint8_t leftPan[SPATIAL_COLS];
+};
+static struct SpatialMap DEFAULT_SPATIAL_MAP;
+const struct SpatialMap *SPATIAL_MAP;
+
+// ripples
+// span tables hold, per radius, each row's outer & inner half widths (inner -1 = no hole)
+int RIPPLE_SPAN_START[RIPPLE_MAX_RADIUS + 1];
+uint8_t RIPPLE_SPAN_OUTER[(RIPPLE_MAX_RADIUS + 1) * (RIPPLE_MAX_RADIUS + 2) / 2];
+int8_t RIPPLE_SPAN_INNER[(RIPPLE_MAX_RADIUS + 1) * (RIPPLE_MAX_RADIUS + 2) / 2];
+int RIPPLE_X[RIPPLE_MAX];
+int RIPPLE_Y[RIPPLE_MAX];
+uint64_t RIPPLE_START[RIPPLE_MAX];
+int RIPPLE_NEXT;
+// what's in the frame now, so it can be XORed back out before the sprites draw
+int RIPPLE_DRAWN_X[RIPPLE_MAX_PER_FRAME];
+int RIPPLE_DRAWN_Y[RIPPLE_MAX_PER_FRAME];
+int RIPPLE_DRAWN_RADIUS[RIPPLE_MAX_PER_FRAME];
+int RIPPLE_DRAWN_COUNT;
+
+#if WATER_FIELD
+// water
+// two height fields with a border of still water, so the step needs no edge checks
+int16_t WATER_A[WATER_ROWS + 2][WATER_COLS + 2];
+int16_t WATER_B[WATER_ROWS + 2][WATER_COLS + 2];
+int16_t (*WATER_CURRENT)[WATER_COLS + 2] = WATER_A;
+int16_t (*WATER_PREVIOUS)[WATER_COLS + 2] = WATER_B;
+// per dither level and 4x4 bayer row, the 4 pixels of a cell (1 = white)
+uint8_t WATER_DITHER[17][4];
+// the dither level each cell was last marked dirty at, what the background sprite draws
+uint8_t WATER_SHOWN[WATER_ROWS][WATER_COLS];
+LCDSprite *WATER_SPRITE;
+#endif
+
+// node control batch
+// inputs are gathered per node, the rest is derived in one pass over the packed arrays
+#define PARAM_BATCH_CAPACITY (BATCH_BENCH ? 256 : MAX_NODES)
+struct ParamBatch
+{
+    int nodeID[PARAM_BATCH_CAPACITY];
+    
+    // inputs
+    float x[PARAM_BATCH_CAPACITY];
+    float y[PARAM_BATCH_CAPACITY];
+    float nodeCloseness[PARAM_BATCH_CAPACITY];
+    float centerCloseness[PARAM_BATCH_CAPACITY];
+    float leftPan[PARAM_BATCH_CAPACITY];
+    float age[PARAM_BATCH_CAPACITY];
+    float lifespan[PARAM_BATCH_CAPACITY];
+    float timeLeft[PARAM_BATCH_CAPACITY];
+    
+    // outputs
+    float freqModRate[PARAM_BATCH_CAPACITY];
+    float freqModPhase[PARAM_BATCH_CAPACITY];
+    float freqModDepth[PARAM_BATCH_CAPACITY];
+    float ampModRate[PARAM_BATCH_CAPACITY];
+    float ampModPhase[PARAM_BATCH_CAPACITY];
+    float ampModDepth[PARAM_BATCH_CAPACITY];
+    float cost[PARAM_BATCH_CAPACITY];
+    int octave[PARAM_BATCH_CAPACITY];
+    float attack[PARAM_BATCH_CAPACITY];
+    float decay[PARAM_BATCH_CAPACITY];
+    float sustain[PARAM_BATCH_CAPACITY];
+    float release[PARAM_BATCH_CAPACITY];
+    float volumeL[PARAM_BATCH_CAPACITY];
+    float volumeR[PARAM_BATCH_CAPACITY];
+    float len[PARAM_BATCH_CAPACITY];
+    float pulseMod[PARAM_BATCH_CAPACITY];
+};
+static struct ParamBatch PARAM_BATCH;
+int TOUCH_QUEUE[MAX_NODES];
+int TOUCH_QUEUE_COUNT;
+
+// timer wheel
+// timer ids are nodeID * NodeTimerCount + NodeTimer, then the global timers
+// slots 0..WHEEL_SLOTS-1 are level 0, WHEEL_SLOTS.. are level 1
+uint64_t TIMER_DUE[TIMER_COUNT];
+int TIMER_NEXT[TIMER_COUNT];
+int TIMER_PREV[TIMER_COUNT];
+int TIMER_SLOT[TIMER_COUNT];
+int WHEEL_HEAD[WHEEL_SLOTS * 2];
+static uint64_t WHEEL_TICK;
+int TIMERS_FIRED;
+
+// audio command ring
+// single producer (main loop), single consumer (audio callback), no locks
+struct AudioCommand AUDIO_QUEUE[AUDIO_QUEUE_SIZE];
+static uint32_t AUDIO_QUEUE_HEAD;
+static uint32_t AUDIO_QUEUE_TAIL;
+int AUDIO_QUEUE_DROPS;
+
+// audio context state, only touched from the audio callback
+struct AudioVoice AUDIO_VOICE[MAX_NODES];
+static uint32_t AUDIO_CLOCK;
+static float AUDIO_CHANNEL_PEAK;
+SoundSource *AUDIO_CONTROL;
+SoundEffect *AUDIO_METER;
+
+// voice engine
+enum VoiceEngine VOICE_ENGINE = SynthEngine;
+#if SAMPLE_VOICES
+// [type][octave variant][intensity variant]
+AudioSample *VOICE_SAMPLE[NodeTypeCount][SAMPLE_OCTAVE_VARIANTS][SAMPLE_INTENSITY_VARIANTS];
+int VOICE_SAMPLE_FRAMES[NodeTypeCount][SAMPLE_OCTAVE_VARIANTS][SAMPLE_INTENSITY_VARIANTS];
+PDMenuItem *ENGINE_MENU;
+#endif
+
+#if MIDI_EXPORT
+// midi export
+SDFile *MIDI_FILE;
+PDMenuItem *MIDI_MENU;
+uint8_t MIDI_BUFFER[MIDI_BUFFER_SIZE];
+int MIDI_BUFFER_USED;
+uint32_t MIDI_TRACK_BYTES;
+uint64_t MIDI_LAST_TICK;
+// pending note off per node & voice, 0 = none
+uint64_t MIDI_NOTE_OFF[MAX_NODES][NODE_MAX_VOICES];
+uint64_t MIDI_NOTE_ON[MAX_NODES][NODE_MAX_VOICES];
+uint8_t MIDI_NOTE[MAX_NODES][NODE_MAX_VOICES];
+int MIDI_EVENTS;
+int MIDI_WRITES;
+#endif
+
+#if WAV_CAPTURE
+// wav capture, 16 bit stereo
+int16_t WAV_BUFFER[2][WAV_BUFFER_FRAMES * 2];
+SoundEffect *WAV_TAP;
+SDFile *WAV_FILE;
+PDMenuItem *WAV_MENU;
+uint32_t WAV_DATA_BYTES;
+// shared with the audio context
+static int WAV_STATE;
+static int WAV_READY[2];
+static uint32_t WAV_DROPS;
+// audio context only
+static int WAV_FILL_BUFFER;
+static int WAV_FILL_FRAMES;
+#endif
+
+#if REWIND || SESSION_RESUME
+// snapshots for rewind & session resume: node state the control side can't recompute on a touch
+// (MAX_NODES fits the 16 bit masks)
+struct SnapshotNode
+{
+    uint8_t type;
+    uint8_t pitchSet;
+    uint8_t gridX;
+    uint8_t gridY;
+    int16_t x;
+    int16_t y;
+    int lifespan;
+    uint64_t deathTime;
+    uint64_t nextPulse;
+};
+struct SnapshotState
+{
+    uint64_t time;
+    uint64_t pitchFieldDue;
+    uint32_t rng;
+    float lifetimeScale;
+    uint16_t liveMask;
+    uint8_t pitchFieldID;
+    uint8_t nodeCap;
+    struct SnapshotNode node[MAX_NODES];
+};
+#endif
+
+#if SESSION_RESUME
+// unpacked, encodeSession & decodeSession do the file layout
+struct SessionFile
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    float timeVelocity;
+    float playerX;
+    float playerY;
+    struct SnapshotState state;
+};
+#endif
+
+#if REWIND
+// stored form: a header, then a record per changed node (every live node in a keyframe), times relative to the tick
+struct RewindHeader
+{
+    uint64_t time;
+    uint64_t pitchFieldDue;
+    uint32_t rng;
+    float lifetimeScale;
+    uint16_t liveMask;
+    uint16_t changedMask;
+    uint8_t pitchFieldID;
+    uint8_t nodeCap;
+    uint8_t key;
+};
+struct RewindRecord
+{
+    uint8_t type;
+    uint8_t pitchSet;
+    uint8_t gridX;
+    uint8_t gridY;
+    int16_t x;
+    int16_t y;
+    int32_t lifespan;
+    int32_t deathTime;
+    int32_t nextPulse;
+};
+uint8_t REWIND_DATA[REWIND_BUDGET];
+uint16_t REWIND_OFFSET[REWIND_ENTRIES];
+int REWIND_FIRST;
+int REWIND_COUNT;
+int REWIND_WRITE;
+int REWIND_SINCE_KEY;
+// the state as of the newest entry, deltas are against it
+struct SnapshotState REWIND_SHADOW;
+int REWINDING;
+int REWIND_POSITION;
+int REWIND_IDLE_FRAMES;
+float REWIND_CRANK;
+float REWIND_WORST_RESTORE;
+#endif
+
+#if MULTIRATE_VOICES
+// sub-rate voices, audio context only (rate classes come in through the command ring)
+struct SubRateVoice SUBRATE_VOICE[MAX_NODES][NODE_MAX_VOICES];
+int32_t SINE_TABLE[1 << SINE_TABLE_BITS];
+// samples handed to CHANNEL vs samples actually computed
+uint32_t SUBRATE_OUTPUT_SAMPLES;
+uint32_t SUBRATE_COMPUTED_SAMPLES;
+int NODE_RATE_FACTOR[MAX_NODES];
+#endif
+
+// audio telemetry
+// audio context -> main loop, published whole behind a sequence counter
+// level & envelope are modelled from the commands each voice was sent: effects only hang off
+// channels, so there's no per-voice tap to measure from, only channelPeak is measured output
+struct AudioTelemetry
+{
+    float level[MAX_NODES];
+    float envelope[MAX_NODES];
+    float peak[MAX_NODES];
+    float channelPeak;
+};
+// odd sequence = audio side mid-write, the main loop keeps its last good copy
+struct AudioTelemetry TELEMETRY;
+static uint32_t TELEMETRY_SEQ;
+struct AudioTelemetry TELEMETRY_VIEW;
+int TELEMETRY_MISSES;
+
+#if AUDIO_STATS
+// audio deadline stats
+static int AUDIO_LAG_BASELINE_SET;
+static int32_t AUDIO_LAG_BASELINE;
+int AUDIO_MISSED_BLOCKS;
+int32_t AUDIO_WORST_LAG;
+uint32_t AUDIO_MAX_QUEUE_DEPTH;
+static uint32_t NEXT_AUDIO_STATS;
+#endif
+
+#if SOAK_TEST
+// soak test
+const int SOAK_STEP = TOUCH_RATE / TOUCH_PHASES;
+// just short of 2^36 samples (~18 days), where a float of the clock is 8192 samples coarse
+const uint64_t SOAK_START_TIME = ((uint64_t)1 << 36) - SAMPLE_RATE * 600;
+const uint64_t SOAK_HOUR = (uint64_t)SAMPLE_RATE * 3600;
+int SOAK_MISTIMED;
+int SOAK_HOURS_DONE;
+float SOAK_WORST_FRAME;
+int SOAK_PEAK_NODES;
+#endif
+
+#if PARAM_SWEEP
+// parameter sweep
+const int SWEEP_STEP = TOUCH_RATE / TOUCH_PHASES;
+const int SWEEP_LIFETIME_SECONDS[SWEEP_VALUES] = { 8, 16, 32 };
+const float SWEEP_PULSE_SCALE[SWEEP_VALUES] = { 0.5f, 1.0f, 2.0f };
+const int SWEEP_RARE_ODDS[SWEEP_VALUES] = { 0, 2, 5 };
+const int SWEEP_PITCH_FIELD_SECONDS[SWEEP_VALUES] = { 15, 30, 60 };
+const int SWEEP_COMBOS = SWEEP_VALUES * SWEEP_VALUES * SWEEP_VALUES * SWEEP_VALUES;
+int SWEEP_COMBO;
+int SWEEP_STEPS;
+int SWEEP_NOTES;
+int SWEEP_PITCH_CLASS[12];
+uint64_t SWEEP_VOICE_SUM;
+int SWEEP_PEAK_VOICES;
+int SWEEP_PEAK_NODES;
+unsigned int SWEEP_STARTED_MS;
+#endif
+
+#if FRAME_STATS
+// frame time histogram
+int FRAME_HIST[FRAME_STATS_BINS];
+int FRAME_HIST_COUNT;
+#endif
+
+#if BENCH_SUITE
+enum BenchScenario
+{
+    BenchEmpty,
+    BenchFull,
+    BenchCrank,
+    BenchStorm,
+    BenchPitchFields,
+    BenchSoak,
+    BenchScenarioCount
+};
+struct BenchScenarioInfo
+{
+    const char *name;
+    int frames;
+};
+const struct BenchScenarioInfo BENCH_SCENARIOS[BenchScenarioCount] =
+{
+    [BenchEmpty] = { "empty", BENCH_FRAMES },
+    // topped back up to the cap every frame
+    [BenchFull] = { "full", BENCH_FRAMES },
+    // time velocity swept back & forth between its limits
+    [BenchCrank] = { "crank", BENCH_FRAMES },
+    // BENCH_STORM_NODES nodes freed & made every frame
+    [BenchStorm] = { "storm", BENCH_FRAMES },
+    // a pitch field change every BENCH_PITCH_FIELD_FRAMES
+    [BenchPitchFields] = { "pitch-fields", BENCH_FRAMES },
+    [BenchSoak] = { "soak", BENCH_SOAK_FRAMES },
+};
+enum BenchMetric
+{
+    BenchFrameMs,
+    BenchWorstFrameMs,
+    BenchControlMs,
+    BenchApiCalls,
+    BenchMetricCount
+};
+const char *BENCH_METRIC_NAMES[BenchMetricCount] = { "frame ms", "worst frame ms", "control ms", "api calls" };
+// allowed on top of BENCH_THRESHOLD, negative is reported but never fails (one frame is too noisy)
+const float BENCH_METRIC_SLACK[BenchMetricCount] = { 0.05f, -1.0f, 0.05f, 0.5f };
+const int BENCH_FRAME_SAMPLES = SAMPLE_RATE / 30;
+float BENCH_RESULTS[BenchScenarioCount][BenchMetricCount];
+int BENCH_SCENARIO;
+// the first frame only sets up
+int BENCH_FRAME = -1;
+float BENCH_FRAME_SECONDS;
+float BENCH_WORST_FRAME;
+float BENCH_CONTROL_SECONDS;
+int BENCH_API_CALLS;
+float BENCH_CRANK_DIRECTION;
+#endif
+
+#if API_TRACE
+// every traced call by the table it lives in, V() for calls without a result & R() for calls with one
+#define API_TRACE_CALLS(V, R) \
+    V(system, getButtonState, (PDButtons *current, PDButtons *pushed, PDButtons *released), (current, pushed, released)) \
+    R(system, float, getCrankChange, (void), ()) \
+    R(system, float, getCrankAngle, (void), ()) \
+    R(system, int, isCrankDocked, (void), ()) \
+    R(system, void *, realloc, (void *ptr, size_t size), (ptr, size)) \
+    R(graphics, uint8_t *, getFrame, (void), ()) \
+    V(graphics, markUpdatedRows, (int start, int end), (start, end)) \
+    V(sprite, moveTo, (LCDSprite *s, float x, float y), (s, x, y)) \
+    V(sprite, setImage, (LCDSprite *s, LCDBitmap *image, LCDBitmapFlip flip), (s, image, flip)) \
+    V(sprite, getPosition, (LCDSprite *s, float *x, float *y), (s, x, y)) \
+    V(sprite, updateAndDrawSprites, (void), ()) \
+    R(sprite, LCDSprite *, copy, (LCDSprite *s), (s)) \
+    V(sprite, addSprite, (LCDSprite *s), (s)) \
+    V(sprite, freeSprite, (LCDSprite *s), (s)) \
+    R(sound, uint32_t, getCurrentTime, (void), ()) \
+    R(channel, int, addSource, (SoundChannel *c, SoundSource *source), (c, source)) \
+    R(channel, int, removeSource, (SoundChannel *c, SoundSource *source), (c, source)) \
+    V(synth, setAttackTime, (PDSynth *synth, float attack), (synth, attack)) \
+    V(synth, setDecayTime, (PDSynth *synth, float decay), (synth, decay)) \
+    V(synth, setSustainLevel, (PDSynth *synth, float sustain), (synth, sustain)) \
+    V(synth, setReleaseTime, (PDSynth *synth, float release), (synth, release)) \
+    V(synth, setWaveform, (PDSynth *synth, SoundWaveform wave), (synth, wave)) \
+    V(synth, setTranspose, (PDSynth *synth, float halfSteps), (synth, halfSteps)) \
+    V(synth, setFrequencyModulator, (PDSynth *synth, PDSynthSignalValue *mod), (synth, mod)) \
+    V(synth, setAmplitudeModulator, (PDSynth *synth, PDSynthSignalValue *mod), (synth, mod)) \
+    V(lfo, setRate, (PDSynthLFO *lfo, float rate), (lfo, rate)) \
+    V(lfo, setPhase, (PDSynthLFO *lfo, float phase), (lfo, phase)) \
+    V(lfo, setDepth, (PDSynthLFO *lfo, float depth), (lfo, depth)) \
+    R(instrument, PDSynth *, playMIDINote, (PDSynthInstrument *inst, MIDINote note, float vel, float len, uint32_t when), (inst, note, vel, len, when)) \
+    V(instrument, setVolume, (PDSynthInstrument *inst, float left, float right), (inst, left, right)) \
+    R(instrument, int, activeVoiceCount, (PDSynthInstrument *inst), (inst)) \
+    V(instrument, allNotesOff, (PDSynthInstrument *inst, uint32_t when), (inst, when))
+
+#define API_TRACE_ID_V(table, name, params, args) ApiTrace_##table##_##name,
+#define API_TRACE_ID_R(table, type, name, params, args) ApiTrace_##table##_##name,
+enum ApiTraceCall { API_TRACE_CALLS(API_TRACE_ID_V, API_TRACE_ID_R) ApiTraceCount };
+
+#define API_TRACE_NAME_V(table, name, params, args) #table "->" #name,
+#define API_TRACE_NAME_R(table, type, name, params, args) #table "->" #name,
+const char *API_TRACE_NAMES[ApiTraceCount] = { API_TRACE_CALLS(API_TRACE_NAME_V, API_TRACE_NAME_R) };
+
+// copies of the tables holding traced calls, one set as handed in & one with the wrappers swapped in
+struct ApiTraceTables
+{
+    struct playdate_sys system;
+    struct playdate_graphics graphics;
+    struct playdate_sprite sprite;
+    struct playdate_sound sound;
+    struct playdate_sound_channel channel;
+    struct playdate_sound_synth synth;
+    struct playdate_sound_lfo lfo;
+    struct playdate_sound_instrument instrument;
+};
+static struct ApiTraceTables API_TRACE_REAL;
+static struct ApiTraceTables API_TRACE_WRAPPED;
+static PlaydateAPI API_TRACE_API;
+
+// this frame
+int API_TRACE_CALLS_THIS_FRAME[ApiTraceCount];
+float API_TRACE_SECONDS_THIS_FRAME[ApiTraceCount];
+// this window
+int API_TRACE_HIST[ApiTraceCount][API_TRACE_BINS];
+int API_TRACE_MAX_CALLS[ApiTraceCount];
+int API_TRACE_TOTAL_CALLS[ApiTraceCount];
+float API_TRACE_TOTAL_SECONDS[ApiTraceCount];
+int API_TRACE_FRAMES;
+#endif
 
 // images
 LCDBitmap *PLAYER_BM;
-LCDBitmap *ROTATED_PLAYER_BM;
-LCDBitmap *NODE_BMT_1[8];
-LCDBitmap *NODE_BMT_2[8];
+// built on first use
+LCDBitmap *ROTATED_PLAYER_BM[PLAYER_ROTATIONS];
+int ROTATED_PLAYER_COUNT;
+int ROTATED_PLAYER_BYTES;
+float ROTATED_PLAYER_SECONDS;
+int PLAYER_ROTATION = -1;
+LCDBitmap *NODE_BMT[NodeTypeCount][8];
+LCDBitmap *NODE_SIZED_BMT[NodeTypeCount][8][NODE_SIZES];
+
+// take random stream (xorshift32), 0..2^31-1 like rand()
+static int takeRand(void)
+{
+    uint32_t x = TAKE_RNG;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    TAKE_RNG = x;
+    return (int)(x >> 1);
+}
+
+static void seedTake(uint32_t seed)
+{
+    // xorshift never leaves 0
+    TAKE_RNG = seed != 0 ? seed : 0x9E3779B9;
+}
 
 // math
 float __attribute__((always_inline)) lerp(float w, float h, float alpha)
@@ -195,497 +936,3354 @@ float __attribute__((always_inline)) distance(int x1, int y1, int x2, int y2)
 }
 
 // specialized utility methods for this toy
-static float closenessToCenter(int x, int y)
+// timer wheel
+static void cancelTimer(int timerID)
 {
-    return (MAX_DISTANCE_FROM_CENTER - distance(x, y, CENTER_X, CENTER_Y)) / MAX_DISTANCE_FROM_CENTER;
+    int slot = TIMER_SLOT[timerID];
+    if (slot == -1) return;
+    if (TIMER_PREV[timerID] == -1) WHEEL_HEAD[slot] = TIMER_NEXT[timerID];
+    else TIMER_NEXT[TIMER_PREV[timerID]] = TIMER_NEXT[timerID];
+    if (TIMER_NEXT[timerID] != -1) TIMER_PREV[TIMER_NEXT[timerID]] = TIMER_PREV[timerID];
+    TIMER_SLOT[timerID] = -1;
 }
 
-static void ageEarliestNode()
+static void linkTimer(int timerID, int slot)
 {
-    int i;
-    for (i = 0; i < MAX_NODES; i++)
-    {
-        if (NODE_TYPE[i] != Dead)
-        {
-            NODE_DEATH_TIME[i] = CURRENT_TIME + NODE_FADE_BUFFER;
-            return;
-        }
-    }
+    TIMER_SLOT[timerID] = slot;
+    TIMER_PREV[timerID] = -1;
+    TIMER_NEXT[timerID] = WHEEL_HEAD[slot];
+    if (WHEEL_HEAD[slot] != -1) TIMER_PREV[WHEEL_HEAD[slot]] = timerID;
+    WHEEL_HEAD[slot] = timerID;
 }
 
-static int quadrantOfPoint(int X, int Y)
+static void placeTimer(int timerID)
 {
-    if (X >= CENTER_X)
+    uint64_t dueTick = TIMER_DUE[timerID] >> WHEEL_SLOT_SHIFT;
+    
+    // anything overdue goes in the slot being processed now
+    if (dueTick < WHEEL_TICK) dueTick = WHEEL_TICK;
+    
+    if (dueTick - WHEEL_TICK < WHEEL_SLOTS)
     {
-        if (Y >= CENTER_Y) return 0;
-        return 1;
+        linkTimer(timerID, dueTick & WHEEL_MASK);
+        return;
     }
-    if (Y >= CENTER_Y) return 2;
-    return 3;
+    
+    // too far out for level 0, park in level 1 (or its furthest slot) and cascade down later
+    uint64_t dueTurn = dueTick >> WHEEL_BITS;
+    uint64_t currentTurn = WHEEL_TICK >> WHEEL_BITS;
+    if (dueTurn - currentTurn >= WHEEL_SLOTS) dueTurn = currentTurn + WHEEL_SLOTS - 1;
+    linkTimer(timerID, WHEEL_SLOTS + (dueTurn & WHEEL_MASK));
 }
 
-static int gridScaleInt(int n) { return floorf((float)n * GRID_SCALE); }
+static void scheduleTimer(int timerID, uint64_t due)
+{
+    cancelTimer(timerID);
+    TIMER_DUE[timerID] = due;
+    placeTimer(timerID);
+}
 
-static float closenessToOtherNodes(int nodeID)
+static void cancelNodeTimers(int nodeID)
 {
-    int rawScore = 0;
-    for (int x = -1; x < 2; x++)
+    for (int i = 0; i < NodeTimerCount; i++) cancelTimer(nodeID * NodeTimerCount + i);
+}
+
+// empty wheel turning from CURRENT_TIME
+static void resetTimerWheel(void)
+{
+    WHEEL_TICK = CURRENT_TIME >> WHEEL_SLOT_SHIFT;
+    for (int i = 0; i < WHEEL_SLOTS * 2; i++) WHEEL_HEAD[i] = -1;
+    for (int i = 0; i < TIMER_COUNT; i++) TIMER_SLOT[i] = -1;
+}
+
+// audio command ring
+// main loop side, never waits: if the audio side has fallen behind the command is dropped & counted
+static int pushAudioCommand(enum AudioCommandType type, int voice, float a, float b, float c, float d)
+{
+    uint32_t head = AUDIO_QUEUE_HEAD;
+    uint32_t tail = __atomic_load_n(&AUDIO_QUEUE_TAIL, __ATOMIC_ACQUIRE);
+    if (head - tail >= AUDIO_QUEUE_SIZE)
     {
-        for (int y = -1; y < 2; y++)
-        {
-            int gridX = x + NODE_GRID_X[nodeID];
-            int gridY = y + NODE_GRID_Y[nodeID];
-            if (gridX > -1 && gridY > -1 && gridX < GRID_WIDTH && gridY < GRID_HEIGHT)
-            {
-                rawScore += GRID_POINT_NODE_COUNT[gridY][gridX];
-            }
-        }
+        AUDIO_QUEUE_DROPS++;
+        return 0;
     }
-    // don't count self
-    rawScore--;
-    if (rawScore > MAX_NODES) rawScore = MAX_NODES;
-    return (float)rawScore / (float)MAX_NODES;
+    
+    struct AudioCommand *command = &AUDIO_QUEUE[head & (AUDIO_QUEUE_SIZE - 1)];
+    command->type = type;
+    command->voice = voice;
+    command->value[0] = a;
+    command->value[1] = b;
+    command->value[2] = c;
+    command->value[3] = d;
+    __atomic_store_n(&AUDIO_QUEUE_HEAD, head + 1, __ATOMIC_RELEASE);
+#if AUDIO_STATS
+    // at its deepest right after a push, the audio side only ever makes it shallower
+    if (head + 1 - tail > AUDIO_MAX_QUEUE_DEPTH) AUDIO_MAX_QUEUE_DEPTH = head + 1 - tail;
+#endif
+    return 1;
 }
 
-// core methods for this toy
-static void freeNode(int nodeID)
+// audio side, applies everything queued so far to the voice state
+static void drainAudioCommands(void)
 {
-    // reset state
-    NODE_TYPE[nodeID] = Dead;
-    NODE_FADE_VOL[nodeID].l = -1.0f;
-    GRID_POINT_NODE_COUNT[NODE_GRID_Y[nodeID]][NODE_GRID_X[nodeID]] -= 1;
-    
-    // free memory
-    const struct playdate_sound *pdSound = PD->sound;
-    pdSound->channel->removeSource(CHANNEL, (SoundSource *)NODE_SYNTH[nodeID]);
-    pdSound->lfo->freeLFO(
-                          (PDSynthLFO *)pdSound->synth->getFrequencyModulator(NODE_SYNTH[nodeID])
-                          );
-    pdSound->lfo->freeLFO(
-                          (PDSynthLFO *)pdSound->synth->getAmplitudeModulator(NODE_SYNTH[nodeID])
-                          );
-    pdSound->synth->freeSynth(NODE_SYNTH[nodeID]);
-    PD->sprite->freeSprite(NODE_SPRITE[nodeID]);
-    
-    // node management
-    LAST_FREED_NODE = nodeID;
-    LIVE_NODE_COUNT--;
+    uint32_t tail = AUDIO_QUEUE_TAIL;
+    uint32_t head = __atomic_load_n(&AUDIO_QUEUE_HEAD, __ATOMIC_ACQUIRE);
+    while (tail != head)
+    {
+        const struct AudioCommand *command = &AUDIO_QUEUE[tail & (AUDIO_QUEUE_SIZE - 1)];
+        struct AudioVoice *voice = &AUDIO_VOICE[command->voice];
+        switch (command->type)
+        {
+            case AudioVoiceClaim:
+                voice->claimed = 1;
+                voice->velocity = 0.0f;
+                voice->peak = 0.0f;
+#if MULTIRATE_VOICES
+                for (int v = 0; v < NODE_MAX_VOICES; v++) SUBRATE_VOICE[command->voice][v] = (struct SubRateVoice){ 0, 1, 0, 0, 0, 0 };
+#endif
+                break;
+            case AudioVoiceRelease:
+                voice->claimed = 0;
+                break;
+            case AudioNoteOn:
+                voice->noteStart = AUDIO_CLOCK;
+                voice->note = command->value[0];
+                voice->velocity = command->value[1];
+                voice->len = command->value[2];
+                break;
+            case AudioVolume:
+                voice->volume[0] = command->value[0];
+                voice->volume[1] = command->value[1];
+                break;
+            case AudioEnvelope:
+                voice->attack = command->value[0];
+                voice->decay = command->value[1];
+                voice->sustain = command->value[2];
+                voice->release = command->value[3];
+                break;
+            case AudioRateClass:
+#if MULTIRATE_VOICES
+                for (int v = 0; v < NODE_MAX_VOICES; v++)
+                {
+                    SUBRATE_VOICE[command->voice][v].factor = (int)command->value[0];
+                    SUBRATE_VOICE[command->voice][v].shift = (int)command->value[1];
+                    SUBRATE_VOICE[command->voice][v].step = 0;
+                }
+#endif
+                break;
+        }
+        tail++;
+    }
+    __atomic_store_n(&AUDIO_QUEUE_TAIL, tail, __ATOMIC_RELEASE);
 }
 
-static void pulseNode(int nodeID)
+#if AUDIO_RING_TEST
+// the audio side's half of the ring protocol, taking up to max commands & checking they come out in order
+static int drainAudioTest(int max, uint32_t *expected)
 {
-    if (CURRENT_TIME >= NODE_NEXT_PULSE[nodeID])
+    uint32_t tail = AUDIO_QUEUE_TAIL;
+    uint32_t head = __atomic_load_n(&AUDIO_QUEUE_HEAD, __ATOMIC_ACQUIRE);
+    int taken = 0;
+    while (tail != head && taken < max)
     {
-        int fieldPitch;
-        int pitch;
-        struct PitchSet set = PITCH_SETS[NODE_PITCH_SET[nodeID]];
-        if (rand() % 10 > RARE_PITCH_ODDS)
+        const struct AudioCommand *command = &AUDIO_QUEUE[tail & (AUDIO_QUEUE_SIZE - 1)];
+        uint32_t seq = (uint32_t)command->value[0] | (uint32_t)command->value[1] << 16;
+        if (seq != *expected || command->voice != *expected % MAX_NODES)
         {
-            fieldPitch = PITCH_FIELD.pitches[set.common[rand() % set.commonCount]];
-        } else {
-            fieldPitch = PITCH_FIELD.pitches[set.rare[rand() % set.rareCount]];
+            PD->system->error("audio ring: got command %u, expected %u", (unsigned)seq, (unsigned)*expected);
+            return -1;
         }
-        pitch = MIDI_START + fieldPitch + 12 * NODE_OCTAVE[nodeID];
-        PD->sound->synth->playMIDINote(
-                                       NODE_SYNTH[nodeID],
-                                       pitch,
-                                       lerp(0.5f, 1.0f, (float)(rand() % 100) * 0.03),
-                                       NODE_LEN[nodeID],
-                                       0
-                                       );
-        float salt = (float)(rand() % 1000);
-        NODE_NEXT_PULSE[nodeID] = CURRENT_TIME + NODE_PULSE_MOD[nodeID] * lerp(SLOW_BASE_PULSE, HIGH_BASE_PULSE, BASE_PULSE) + salt;
+        (*expected)++;
+        tail++;
+        taken++;
     }
+    __atomic_store_n(&AUDIO_QUEUE_TAIL, tail, __ATOMIC_RELEASE);
+    return taken;
 }
 
-// update node sound and management & maybe pulse the node
-static void touchNode(int nodeID)
+// floods, random bursts & partial drains across the index wrap, every push has to come out in
+// order or be counted as a drop exactly when the ring was full
+// (single threaded: it runs before the channel exists so the audio side can't interleave, which
+// checks the index & drop bookkeeping but not the acquire/release ordering between the two threads,
+// the device has no second thread for us to race it with)
+static void testAudioRing(void)
 {
-    // if node should die, kill it and return early
-    if (CURRENT_TIME > NODE_DEATH_TIME[nodeID])
+    int drops = AUDIO_QUEUE_DROPS;
+    AUDIO_QUEUE_HEAD = AUDIO_QUEUE_TAIL = UINT32_MAX - AUDIO_QUEUE_SIZE * 3;
+    uint32_t pushed = 0;
+    uint32_t expected = 0;
+    int dropped = 0;
+    
+    for (int round = 0; round < AUDIO_RING_TEST_ROUNDS; round++)
+    {
+        // every 100th round floods well past full
+        int burst = round % 100 == 0 ? AUDIO_QUEUE_SIZE * 2 : rand() % AUDIO_QUEUE_SIZE;
+        for (int i = 0; i < burst; i++)
+        {
+            int full = AUDIO_QUEUE_HEAD - AUDIO_QUEUE_TAIL >= AUDIO_QUEUE_SIZE;
+            int accepted = pushAudioCommand(AudioVolume, pushed % MAX_NODES, (float)(pushed & 0xffff), (float)(pushed >> 16), 0.0f, 0.0f);
+            if (accepted == full)
+            {
+                PD->system->error("audio ring: push %u %s with %d queued", (unsigned)pushed, accepted ? "accepted" : "dropped",
+                                  (int)(AUDIO_QUEUE_HEAD - AUDIO_QUEUE_TAIL));
+                return;
+            }
+            if (accepted) pushed++;
+            else dropped++;
+        }
+        if (drainAudioTest(rand() % AUDIO_QUEUE_SIZE, &expected) < 0) return;
+    }
+    if (drainAudioTest(AUDIO_QUEUE_SIZE, &expected) < 0) return;
+    
+    if (expected != pushed || AUDIO_QUEUE_DROPS - drops != dropped)
     {
-        freeNode(nodeID);
+        PD->system->error("audio ring: %u pushed, %u drained, %d dropped but %d counted",
+                          (unsigned)pushed, (unsigned)expected, dropped, AUDIO_QUEUE_DROPS - drops);
         return;
     }
+    PD->system->logToConsole("audio ring: %u commands in order, %d drops counted", (unsigned)pushed, dropped);
     
-    // do look ups
-    const struct playdate_sound_synth *pdSynth = PD->sound->synth;
-    PDSynth *synth = NODE_SYNTH[nodeID];
+    AUDIO_QUEUE_HEAD = AUDIO_QUEUE_TAIL = 0;
+    AUDIO_QUEUE_DROPS = drops;
+}
+#endif
+
+// where a voice's envelope is, modelled from the note & envelope it was last sent (not measured)
+static float audioVoiceEnvelope(const struct AudioVoice *voice)
+{
+    if (!voice->claimed || voice->velocity == 0.0f) return 0.0f;
     
-    float x, y;
-    PD->sprite->getPosition(NODE_SPRITE[nodeID], &x, &y);
-    float nodeCloseness = closenessToOtherNodes(nodeID);
+    float t = (float)(AUDIO_CLOCK - voice->noteStart) * (1.0f / (float)SAMPLE_RATE);
+    float env;
+    if (t < voice->attack) env = t / voice->attack;
+    else if (t < voice->attack + voice->decay) env = 1.0f - (1.0f - voice->sustain) * (t - voice->attack) / voice->decay;
+    else if (t < voice->len) env = voice->sustain;
+    else if (t < voice->len + voice->release) env = voice->sustain * (1.0f - (t - voice->len) / voice->release);
+    else env = 0.0f;
     
-    // touch timbre
+    return env;
+}
+
+// audio side, never waits on the main loop
+static void publishTelemetry(void)
+{
+    __atomic_store_n(&TELEMETRY_SEQ, TELEMETRY_SEQ + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (int i = 0; i < MAX_NODES; i++)
     {
-        const struct playdate_sound_lfo *pdLFO = PD->sound->lfo;
-        
-        // freq mod
-        struct PDSynthLFO* freqMod =
-            (PDSynthLFO *)pdSynth->getFrequencyModulator(NODE_SYNTH[nodeID]);
-        // closeness to other nodes = more intense
-        float freqModAlpha = 1.0f - nodeCloseness;
-        pdLFO->setRate(freqMod, lerp(MIN_FREQ_MOD_RATE, MAX_FREQ_MOD_RATE, freqModAlpha));
-        pdLFO->setPhase(freqMod, lerp(MIN_FREQ_MOD_PHASE, MAX_FREQ_MOD_PHASE, freqModAlpha));
-        pdLFO->setDepth(freqMod, lerp(MIN_FREQ_MOD_DEPTH, MAX_FREQ_MOD_DEPTH, freqModAlpha));
-        
-        // amp mod
-        struct PDSynthLFO* ampMod =
-            (PDSynthLFO *)pdSynth->getAmplitudeModulator(NODE_SYNTH[nodeID]);
-        // closeness to other nodes = more intense
-        float ampModAlpha = 1.0f - nodeCloseness;
-        pdLFO->setRate(ampMod, lerp(MIN_AMP_MOD_RATE, MAX_AMP_MOD_RATE, ampModAlpha));
-        pdLFO->setPhase(ampMod, lerp(MIN_AMP_MOD_PHASE, MAX_AMP_MOD_PHASE, ampModAlpha));
-        pdLFO->setDepth(ampMod, lerp(MIN_AMP_MOD_DEPTH, MAX_AMP_MOD_DEPTH, ampModAlpha));
-        
-        pdSynth->setFrequencyModulator(synth, (PDSynthSignalValue *)freqMod);
-        pdSynth->setAmplitudeModulator(synth, (PDSynthSignalValue *)ampMod);
+        struct AudioVoice *voice = &AUDIO_VOICE[i];
+        float envelope = audioVoiceEnvelope(voice);
+        float level = envelope * voice->velocity * (voice->volume[0] + voice->volume[1]);
+        voice->peak *= PEAK_DECAY;
+        if (level > voice->peak) voice->peak = level;
+        TELEMETRY.level[i] = level;
+        TELEMETRY.envelope[i] = envelope;
+        TELEMETRY.peak[i] = voice->peak;
     }
-    
-    // touch octave
-    NODE_OCTAVE[nodeID] = floorf(lerp(NODE_MIN_OCTAVE, NODE_MAX_OCTAVE, 1.0f - (float)y / (float)LCD_ROWS));
-    
-    // touch envelope
+    TELEMETRY.channelPeak = AUDIO_CHANNEL_PEAK;
+    __atomic_store_n(&TELEMETRY_SEQ, TELEMETRY_SEQ + 1, __ATOMIC_RELEASE);
+}
+
+// main loop side, a torn read is retried a couple of times then skipped for this frame
+static void readTelemetry(void)
+{
+    for (int attempt = 0; attempt < 3; attempt++)
     {
-        // node type 1 = harsher
-        // less life left = smoother
-        float envAlpha = (float)(CURRENT_TIME - (NODE_DEATH_TIME[nodeID] - NODE_LIFETIME)) / (float)(NODE_LIFETIME);
-        if (NODE_TYPE[nodeID] == 1)
-        {
-            pdSynth->setAttackTime(synth, lerp(NODE_MIN_ATTACK_1, NODE_MAX_ATTACK_1, envAlpha));
-            pdSynth->setDecayTime(synth, lerp(NODE_MIN_DECAY_1, NODE_MAX_DECAY_1, envAlpha));
-            pdSynth->setSustainLevel(synth, lerp(NODE_MIN_SUSTAIN_1, NODE_MAX_SUSTAIN_1, envAlpha));
-            pdSynth->setReleaseTime(synth, lerp(NODE_MIN_RELEASE_1, NODE_MAX_RELEASE_1, envAlpha));
-        }
-        else
+        uint32_t seq = __atomic_load_n(&TELEMETRY_SEQ, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        struct AudioTelemetry copy = TELEMETRY;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&TELEMETRY_SEQ, __ATOMIC_RELAXED) == seq)
         {
-            pdSynth->setAttackTime(synth, lerp(NODE_MIN_ATTACK_2, NODE_MAX_ATTACK_2, envAlpha));
-            pdSynth->setDecayTime(synth, lerp(NODE_MIN_DECAY_2, NODE_MAX_DECAY_2, envAlpha));
-            pdSynth->setSustainLevel(synth, lerp(NODE_MIN_SUSTAIN_2, NODE_MAX_SUSTAIN_2, envAlpha));
-            pdSynth->setReleaseTime(synth, lerp(NODE_MIN_RELEASE_2, NODE_MAX_RELEASE_2, envAlpha));
+            TELEMETRY_VIEW = copy;
+            return;
         }
     }
-    
-    
-    // touch volume
-    // closeness to other nodes = louder
-    // slight hairpin in and fadeout with lifetime (can replace the whole fadeout mechanic probably)
+    TELEMETRY_MISSES++;
+}
+
+// silent source on CHANNEL, so the queue is drained once per render block in the audio context
+static int audioControlSource(void* context, int16_t* left, int16_t* right, int len)
+{
+    (void)context; (void)left; (void)right;
+    drainAudioCommands();
+    AUDIO_CLOCK += len;
+    publishTelemetry();
+    return 0;
+}
+
+// last effect on CHANNEL, measures the output peak per block without touching it
+static int audioMeterEffect(SoundEffect* e, int32_t* left, int32_t* right, int nsamples, int bufactive)
+{
+    (void)e;
+    int32_t peak = 0;
+    if (bufactive)
     {
-        float lifespanAlpha = 1.0f;
-        if (CURRENT_TIME > NODE_DEATH_TIME[nodeID] - NODE_FADE_BUFFER)
+        for (int i = 0; i < nsamples; i++)
         {
-            lifespanAlpha = (float)(NODE_DEATH_TIME[nodeID] - CURRENT_TIME) * INVERSE_FADE_BUFFER;
+            int32_t l = left[i] < 0 ? -left[i] : left[i];
+            int32_t r = right[i] < 0 ? -right[i] : right[i];
+            if (l > peak) peak = l;
+            if (r > peak) peak = r;
         }
-        float baseVol = lifespanAlpha * (0.8f * nodeCloseness + 0.2f);
-        float leftPan = (float)x / (float)LCD_COLUMNS;
-        pdSynth->setVolume(
-                           synth,
-                           lerp(0.0f, baseVol, leftPan),
-                           lerp(0.0f, baseVol, 1.0f - leftPan)
-                           );
-    }
-    
-    // touch length
-    // closeness to center = shorter
-    float centerCloseness = closenessToCenter(x, y);
-    NODE_LEN[nodeID] = lerp(NODE_MIN_LEN, NODE_MAX_LEN, 1.0f - centerCloseness);
-    
-    // touch pulse
-    // closeness to center = faster
-    NODE_PULSE_MOD[nodeID] = BASE_PULSE * lerp(NODE_MAX_PULSE_MOD, NODE_MIN_PULSE_MOD, centerCloseness);
-    
-    // touch position
-    x += (float)(rand() % 2) - 0.5f;
-    y += (float)(rand() % 2) - 0.5f;
-    if (x > (float)LCD_COLUMNS) x -= (float)LCD_COLUMNS;
-    if (y > (float)LCD_ROWS) y -= (float)LCD_ROWS;
-    if (x < 0.0f) x += (float)LCD_COLUMNS;
-    if (y < 0.0f) y += (float)LCD_ROWS;
-    PD->sprite->moveTo(NODE_SPRITE[nodeID], x, y);
-    
-    // touch sprites
-    NODE_ANIM_STATE[nodeID] = (NODE_ANIM_STATE[nodeID] + 1) % 8;
-    if (NODE_TYPE[nodeID] == 1)
-    {
-        PD->sprite->setImage(NODE_SPRITE[nodeID], NODE_BMT_1[NODE_ANIM_STATE[nodeID]], kBitmapUnflipped);
-    }
-    else if (NODE_TYPE[nodeID] == 2)
-    {
-        PD->sprite->setImage(NODE_SPRITE[nodeID], NODE_BMT_2[NODE_ANIM_STATE[nodeID]], kBitmapUnflipped);
     }
-    
-    // pulse
-    pulseNode(nodeID);
+    // q8.24
+    AUDIO_CHANNEL_PEAK = (float)peak * (1.0f / (float)(1 << 24));
+    return 0;
 }
 
-static void makeNode(enum NodeType type, int X, int Y)
+#if WAV_CAPTURE
+// q8.24 -> 16 bit
+static inline int16_t wavSample(int32_t v)
 {
-    // if node count is max - 1 (i.e. room for only 1 more node), trigger an older node to fade out and die
-    // (this means the real max is actually max - 1)
-    if (!(LIVE_NODE_COUNT < MAX_NODES - 1)) ageEarliestNode();
-    
-    // if we have too many nodes, return early
-    if (LIVE_NODE_COUNT > MAX_NODES - 1) return;
+    v >>= 9;
+    if (v > 32767) v = 32767;
+    if (v < -32768) v = -32768;
+    return (int16_t)v;
+}
+
+static int wavTapEffect(SoundEffect* e, int32_t* left, int32_t* right, int nsamples, int bufactive)
+{
+    (void)e;
+    int state = __atomic_load_n(&WAV_STATE, __ATOMIC_ACQUIRE);
+    if (state == WavStopping)
+    {
+        // hand the fill buffer back, this block & every one after leave it alone
+        __atomic_store_n(&WAV_STATE, WavStopped, __ATOMIC_RELEASE);
+        return 0;
+    }
+    if (state != WavCapturing) return 0;
     
-    int nodeID = -1;
-    if (LAST_FREED_NODE == -1)
+    int16_t *out = WAV_BUFFER[WAV_FILL_BUFFER] + WAV_FILL_FRAMES * 2;
+    for (int i = 0; i < nsamples; i++)
     {
-        while (nodeID == -1)
+        if (WAV_FILL_FRAMES == WAV_BUFFER_FRAMES)
         {
-            for (int i = 0; i < MAX_NODES; i++)
+            int next = WAV_FILL_BUFFER ^ 1;
+            // the main loop hasn't written the other buffer yet: drop this one & refill it
+            if (__atomic_load_n(&WAV_READY[next], __ATOMIC_ACQUIRE)) __atomic_store_n(&WAV_DROPS, WAV_DROPS + 1, __ATOMIC_RELAXED);
+            else
             {
-                if (NODE_TYPE[i] == Dead) nodeID = i;
+                __atomic_store_n(&WAV_READY[WAV_FILL_BUFFER], 1, __ATOMIC_RELEASE);
+                WAV_FILL_BUFFER = next;
             }
+            WAV_FILL_FRAMES = 0;
+            out = WAV_BUFFER[WAV_FILL_BUFFER];
         }
+        *out++ = bufactive ? wavSample(left[i]) : 0;
+        *out++ = bufactive ? wavSample(right[i]) : 0;
+        WAV_FILL_FRAMES++;
     }
-    else
-    {
-        nodeID = LAST_FREED_NODE;
-        LAST_FREED_NODE = -1;
-    }
+    return 0;
+}
+
+static void writeWav(const void *data, int bytes)
+{
+    if (PD->file->write(WAV_FILE, data, bytes) < 0) ERR = PD->file->geterr();
+    WAV_DATA_BYTES += bytes;
+}
+
+// main loop: write out whichever buffer the tap has finished with
+static void flushWav(void)
+{
+    for (int b = 0; b < 2; b++)
+    {
+        if (!__atomic_load_n(&WAV_READY[b], __ATOMIC_ACQUIRE)) continue;
+        writeWav(WAV_BUFFER[b], sizeof(WAV_BUFFER[b]));
+        __atomic_store_n(&WAV_READY[b], 0, __ATOMIC_RELEASE);
+    }
+}
+
+static void putLE32(uint8_t *out, uint32_t v)
+{
+    out[0] = v & 0xFF;
+    out[1] = (v >> 8) & 0xFF;
+    out[2] = (v >> 16) & 0xFF;
+    out[3] = v >> 24;
+}
+
+// sizes are patched in on close
+static void startWavCapture(void)
+{
+    char *name = NULL;
+    PD->system->formatString(&name, "ripplesynth-%u.wav", PD->system->getSecondsSinceEpoch(NULL));
+    WAV_FILE = PD->file->open(name, kFileWrite);
+    PD->system->realloc(name, 0);
+    if (WAV_FILE == NULL)
+    {
+        ERR = PD->file->geterr();
+        PD->system->setMenuItemValue(WAV_MENU, 0);
+        return;
+    }
+    
+    uint8_t header[44] = {
+        'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+        'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 2, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 16, 0,
+        'd', 'a', 't', 'a', 0, 0, 0, 0
+    };
+    putLE32(header + 24, SAMPLE_RATE);
+    putLE32(header + 28, SAMPLE_RATE * 4);
+    PD->file->write(WAV_FILE, header, sizeof(header));
+    
+    WAV_DATA_BYTES = 0;
+    WAV_DROPS = 0;
+    WAV_FILL_BUFFER = 0;
+    WAV_FILL_FRAMES = 0;
+    WAV_READY[0] = 0;
+    WAV_READY[1] = 0;
+    __atomic_store_n(&WAV_STATE, WavCapturing, __ATOMIC_RELEASE);
+}
+
+// ask the tap to stop, the file is finished once it has acknowledged
+static void stopWavCapture(void)
+{
+    if (WAV_FILE == NULL) return;
+    int capturing = WavCapturing;
+    __atomic_compare_exchange_n(&WAV_STATE, &capturing, WavStopping, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+// main loop, only once the tap is WavStopped (or the audio isn't running)
+static void finishWavCapture(void)
+{
+    flushWav();
+    writeWav(WAV_BUFFER[WAV_FILL_BUFFER], WAV_FILL_FRAMES * 2 * sizeof(int16_t));
+    
+    uint8_t size[4];
+    putLE32(size, WAV_DATA_BYTES + 36);
+    PD->file->seek(WAV_FILE, 4, SEEK_SET);
+    PD->file->write(WAV_FILE, size, sizeof(size));
+    putLE32(size, WAV_DATA_BYTES);
+    PD->file->seek(WAV_FILE, 40, SEEK_SET);
+    PD->file->write(WAV_FILE, size, sizeof(size));
+    PD->file->close(WAV_FILE);
+    WAV_FILE = NULL;
+    __atomic_store_n(&WAV_STATE, WavIdle, __ATOMIC_RELAXED);
+    PD->system->logToConsole("wav capture: %.1f s written, %u buffers dropped",
+                             (double)((float)WAV_DATA_BYTES / (float)(SAMPLE_RATE * 4)),
+                             __atomic_load_n(&WAV_DROPS, __ATOMIC_RELAXED));
+}
+
+// per frame: write out finished buffers, close the file once the tap has let go
+static void updateWavCapture(void)
+{
+    flushWav();
+    if (__atomic_load_n(&WAV_STATE, __ATOMIC_ACQUIRE) != WavStopped) return;
+    finishWavCapture();
+    // switched back on while the stop was in flight
+    if (PD->system->getMenuItemValue(WAV_MENU)) startWavCapture();
+}
+
+// on terminate there's no next frame, wait (briefly) for the tap here
+static void stopWavCaptureNow(void)
+{
+    if (WAV_FILE == NULL) return;
+    stopWavCapture();
+    unsigned int started = PD->system->getCurrentTimeMilliseconds();
+    while (__atomic_load_n(&WAV_STATE, __ATOMIC_ACQUIRE) != WavStopped)
+    {
+        // no block in all that time, the audio side has stopped calling the tap
+        if (PD->system->getCurrentTimeMilliseconds() - started > WAV_STOP_TIMEOUT_MS) break;
+    }
+    finishWavCapture();
+}
+
+static void wavMenuChanged(void* userdata)
+{
+    (void)userdata;
+    if (PD->system->getMenuItemValue(WAV_MENU)) { if (WAV_FILE == NULL) startWavCapture(); }
+    else stopWavCapture();
+}
+#endif
+
+static void ageEarliestNode()
+{
+    int i;
+    for (i = 0; i < MAX_NODES; i++)
+    {
+        // skip nodes that are already fading out, or we'd just keep extending their lives
+        if (NODE_TYPE[i] != Dead && NODE_DEATH_TIME[i] > CURRENT_TIME + NODE_FADE_BUFFER)
+        {
+            NODE_DEATH_TIME[i] = CURRENT_TIME + NODE_FADE_BUFFER;
+            scheduleTimer(i * NodeTimerCount + DeathTimer, NODE_DEATH_TIME[i]);
+            return;
+        }
+    }
+}
+
+static int quadrantOfPoint(int X, int Y)
+{
+    if (X >= CENTER_X)
+    {
+        if (Y >= CENTER_Y) return 0;
+        return 1;
+    }
+    if (Y >= CENTER_Y) return 2;
+    return 3;
+}
+
+static int gridScaleInt(int n) { return floorf((float)n * GRID_SCALE); }
+
+static int spatialCell(float n, int cells)
+{
+    int cell = (int)n >> SPATIAL_CELL_SHIFT;
+    if (cell < 0) return 0;
+    if (cell >= cells) return cells - 1;
+    return cell;
+}
+
+// bake the positional parameters around a center point
+static void buildSpatialMap(struct SpatialMap *map, float centerX, float centerY)
+{
+    float maxDistance = distance(0, 0, centerX, centerY);
+    for (int row = 0; row < SPATIAL_ROWS; row++)
+    {
+        // sample at the middle of each cell
+        int y = (row << SPATIAL_CELL_SHIFT) + (1 << SPATIAL_CELL_SHIFT) / 2;
+        map->octave[row] = floorf(lerp(NODE_MIN_OCTAVE, NODE_MAX_OCTAVE, 1.0f - (float)y / (float)LCD_ROWS));
+        for (int col = 0; col < SPATIAL_COLS; col++)
+        {
+            int x = (col << SPATIAL_CELL_SHIFT) + (1 << SPATIAL_CELL_SHIFT) / 2;
+            float closeness = (maxDistance - distance(x, y, centerX, centerY)) / maxDistance;
+            if (closeness < 0.0f) closeness = 0.0f;
+            map->centerCloseness[row][col] = (uint8_t)(closeness * 255.0f);
+            map->quadrant[row][col] = quadrantOfPoint(x, y);
+        }
+    }
+    for (int col = 0; col < SPATIAL_COLS; col++)
+    {
+        int x = (col << SPATIAL_CELL_SHIFT) + (1 << SPATIAL_CELL_SHIFT) / 2;
+        float pan = (float)x / (float)LCD_COLUMNS;
+        if (pan > 1.0f) pan = 1.0f;
+        map->leftPan[col] = (uint8_t)(pan * 255.0f);
+    }
+}
+
+// next touch time after now that falls on this node's phase slot, so touches spread evenly over frames
+static uint64_t nextTouchSlot(int nodeID)
+{
+    uint64_t phase = (uint64_t)((nodeID % TOUCH_PHASES) * TOUCH_RATE / TOUCH_PHASES);
+    uint64_t sinceEpoch = CURRENT_TIME - TOUCH_EPOCH;
+    uint64_t periodStart = sinceEpoch - sinceEpoch % TOUCH_RATE;
+    uint64_t next = TOUCH_EPOCH + periodStart + phase;
+    if (next <= CURRENT_TIME) next += TOUCH_RATE;
+    return next;
+}
+
+static float closenessToOtherNodes(int nodeID)
+{
+    int rawScore = 0;
+    for (int x = -1; x < 2; x++)
+    {
+        for (int y = -1; y < 2; y++)
+        {
+            int gridX = x + NODE_GRID_X[nodeID];
+            int gridY = y + NODE_GRID_Y[nodeID];
+            if (gridX > -1 && gridY > -1 && gridX < GRID_WIDTH && gridY < GRID_HEIGHT)
+            {
+                rawScore += GRID_POINT_NODE_COUNT[gridY][gridX];
+            }
+        }
+    }
+    // don't count self
+    rawScore--;
+    if (rawScore > MAX_NODES) rawScore = MAX_NODES;
+    return (float)rawScore / (float)MAX_NODES;
+}
+
+// core methods for this toy
+static void freeNode(int nodeID)
+{
+    // reset state
+    enum NodeType type = NODE_TYPE[nodeID];
+    NODE_TYPE[nodeID] = Dead;
+    NODE_FADE_VOL[nodeID].l = -1.0f;
+    NODE_COST[nodeID] = 0.0f;
+    cancelNodeTimers(nodeID);
+    pushAudioCommand(AudioVoiceRelease, nodeID, 0.0f, 0.0f, 0.0f, 0.0f);
+    GRID_POINT_NODE_COUNT[NODE_GRID_Y[nodeID]][NODE_GRID_X[nodeID]] -= 1;
+    
+    // free memory
+    const struct playdate_sound *pdSound = PD->sound;
+    if (NODE_CULLED[nodeID])
+    {
+        NODE_CULLED[nodeID] = 0;
+        CULLED_NODE_COUNT--;
+    }
+    else pdSound->channel->removeSource(CHANNEL, (SoundSource *)NODE_INSTRUMENT[nodeID]);
+    // the instrument goes back to its type's pool, voices & all
+    pdSound->instrument->allNotesOff(NODE_INSTRUMENT[nodeID], 0);
+    TYPE_POOL_FREE[type][TYPE_POOL_FREE_COUNT[type]++] = NODE_POOL_ENTRY[nodeID];
+    PD->sprite->freeSprite(NODE_SPRITE[nodeID]);
+    
+    // node management
+    LAST_FREED_NODE = nodeID;
+    LIVE_NODE_COUNT--;
+}
+
+// ripples
+static void buildRippleSpans(void)
+{
+    int offset = 0;
+    for (int r = 0; r <= RIPPLE_MAX_RADIUS; r++)
+    {
+        RIPPLE_SPAN_START[r] = offset;
+        for (int dy = 0; dy <= r; dy++)
+        {
+            RIPPLE_SPAN_OUTER[offset + dy] = floorf(sqrtf((float)(r * r - dy * dy)));
+            // 1 pixel ring: the hole is the circle one smaller
+            if (dy < r) RIPPLE_SPAN_INNER[offset + dy] = floorf(sqrtf((float)((r - 1) * (r - 1) - dy * dy)));
+            else RIPPLE_SPAN_INNER[offset + dy] = -1;
+        }
+        offset += r + 1;
+    }
+}
+
+static void xorSpan(uint8_t *row, int x0, int x1)
+{
+    if (x0 < 0) x0 = 0;
+    if (x1 > LCD_COLUMNS - 1) x1 = LCD_COLUMNS - 1;
+    if (x0 > x1) return;
+    
+    int byte0 = x0 >> 3;
+    int byte1 = x1 >> 3;
+    uint8_t mask0 = 0xFF >> (x0 & 7);
+    uint8_t mask1 = 0xFF << (7 - (x1 & 7));
+    if (byte0 == byte1)
+    {
+        row[byte0] ^= mask0 & mask1;
+        return;
+    }
+    row[byte0] ^= mask0;
+    for (int i = byte0 + 1; i < byte1; i++) row[i] ^= 0xFF;
+    row[byte1] ^= mask1;
+}
+
+static void xorRingRow(uint8_t *frame, int y, int cx, int outer, int inner)
+{
+    if (y < 0 || y >= LCD_ROWS) return;
+    uint8_t *row = frame + y * LCD_ROWSIZE;
+    if (inner < 0)
+    {
+        xorSpan(row, cx - outer, cx + outer);
+        return;
+    }
+    xorSpan(row, cx - outer, cx - inner - 1);
+    xorSpan(row, cx + inner + 1, cx + outer);
+}
+
+static void xorRing(uint8_t *frame, int cx, int cy, int r)
+{
+    int offset = RIPPLE_SPAN_START[r];
+    xorRingRow(frame, cy, cx, RIPPLE_SPAN_OUTER[offset], RIPPLE_SPAN_INNER[offset]);
+    for (int dy = 1; dy <= r; dy++)
+    {
+        xorRingRow(frame, cy - dy, cx, RIPPLE_SPAN_OUTER[offset + dy], RIPPLE_SPAN_INNER[offset + dy]);
+        xorRingRow(frame, cy + dy, cx, RIPPLE_SPAN_OUTER[offset + dy], RIPPLE_SPAN_INNER[offset + dy]);
+    }
+}
+
+// a full pool recycles the oldest ripple
+static void spawnRipple(int x, int y)
+{
+    RIPPLE_X[RIPPLE_NEXT] = x;
+    RIPPLE_Y[RIPPLE_NEXT] = y;
+    RIPPLE_START[RIPPLE_NEXT] = CURRENT_TIME;
+    RIPPLE_NEXT = (RIPPLE_NEXT + 1) % RIPPLE_MAX;
+}
+
+static void markRingRows(int cy, int r, int *top, int *bottom)
+{
+    if (cy - r < *top) *top = cy - r;
+    if (cy + r > *bottom) *bottom = cy + r;
+}
+
+// take last frame's rings back out, before the water or sprites draw over them
+// (XOR restores whatever was under a ring, so it works the same over water)
+static void eraseRipples(void)
+{
+    if (RIPPLE_DRAWN_COUNT == 0) return;
+    uint8_t *frame = PD->graphics->getFrame();
+    int top = LCD_ROWS;
+    int bottom = -1;
+    for (int i = 0; i < RIPPLE_DRAWN_COUNT; i++)
+    {
+        xorRing(frame, RIPPLE_DRAWN_X[i], RIPPLE_DRAWN_Y[i], RIPPLE_DRAWN_RADIUS[i]);
+        markRingRows(RIPPLE_DRAWN_Y[i], RIPPLE_DRAWN_RADIUS[i], &top, &bottom);
+    }
+    RIPPLE_DRAWN_COUNT = 0;
+    if (top < 0) top = 0;
+    if (bottom > LCD_ROWS - 1) bottom = LCD_ROWS - 1;
+    if (top <= bottom) PD->graphics->markUpdatedRows(top, bottom);
+}
+
+// newest first, so the cap drops the oldest & faintest
+static void drawRipples(void)
+{
+    uint8_t *frame = PD->graphics->getFrame();
+    int top = LCD_ROWS;
+    int bottom = -1;
+    for (int n = 1; n <= RIPPLE_MAX && RIPPLE_DRAWN_COUNT < RIPPLE_MAX_PER_FRAME; n++)
+    {
+        int i = (RIPPLE_NEXT - n + RIPPLE_MAX) % RIPPLE_MAX;
+        if (RIPPLE_START[i] == 0 || CURRENT_TIME < RIPPLE_START[i]) continue;
+        int r = (int)((CURRENT_TIME - RIPPLE_START[i]) * RIPPLE_SPEED / SAMPLE_RATE) + 1;
+        if (r > RIPPLE_MAX_RADIUS) continue;
+        
+        xorRing(frame, RIPPLE_X[i], RIPPLE_Y[i], r);
+        markRingRows(RIPPLE_Y[i], r, &top, &bottom);
+        RIPPLE_DRAWN_X[RIPPLE_DRAWN_COUNT] = RIPPLE_X[i];
+        RIPPLE_DRAWN_Y[RIPPLE_DRAWN_COUNT] = RIPPLE_Y[i];
+        RIPPLE_DRAWN_RADIUS[RIPPLE_DRAWN_COUNT] = r;
+        RIPPLE_DRAWN_COUNT++;
+    }
+    if (top < 0) top = 0;
+    if (bottom > LCD_ROWS - 1) bottom = LCD_ROWS - 1;
+    if (top <= bottom) PD->graphics->markUpdatedRows(top, bottom);
+}
+
+#if MULTIRATE_VOICES
+static void buildSineTable(void)
+{
+    for (int i = 0; i < (1 << SINE_TABLE_BITS); i++)
+    {
+        // q8.24
+        SINE_TABLE[i] = (int32_t)(sinf((float)i * 2.0f * 3.14159265f / (float)(1 << SINE_TABLE_BITS)) * (float)(1 << 24));
+    }
+}
+
+// synth generator: a new sine sample every factor'th output sample, linearly interpolated in between
+// (a 2 tap polyphase upsampler; low octave sines have nothing up high for it to smear)
+// the synth applies envelope, amp mod & volume on top
+static int subRateRender(void* userdata, int32_t* left, int32_t* right, int nsamples, uint32_t rate, int32_t drate)
+{
+    (void)right;
+    struct SubRateVoice *voice = userdata;
+    int factor = voice->factor;
+    int shift = voice->shift;
+    int computed = 0;
+    for (int i = 0; i < nsamples; i++)
+    {
+        if (voice->step == 0)
+        {
+            voice->previous = voice->current;
+            voice->current = SINE_TABLE[voice->phase >> (32 - SINE_TABLE_BITS)];
+            voice->phase += rate << shift;
+            computed++;
+        }
+        left[i] += voice->previous + ((voice->current - voice->previous) >> shift) * voice->step;
+        voice->step = (voice->step + 1) & (factor - 1);
+        rate += drate;
+    }
+    SUBRATE_OUTPUT_SAMPLES += nsamples;
+    SUBRATE_COMPUTED_SAMPLES += computed;
+    return nsamples;
+}
+
+static void subRateNoteOn(void* userdata, MIDINote note, float velocity, float len)
+{
+    (void)userdata; (void)note; (void)velocity; (void)len;
+}
+
+static void subRateRelease(void* userdata, int stop)
+{
+    (void)userdata; (void)stop;
+}
+
+static int subRateSetParameter(void* userdata, int parameter, float value)
+{
+    (void)userdata; (void)parameter; (void)value;
+    return 0;
+}
+
+static void subRateDealloc(void* userdata)
+{
+    (void)userdata;
+}
+
+// lower & purer = slower
+static void setRateClass(int nodeID)
+{
+    if (!NODE_TYPE_INFO[NODE_TYPE[nodeID]].subRate || NODE_ENGINE[nodeID] != SynthEngine) return;
+    int shift = 0;
+    if (NODE_OCTAVE[nodeID] <= MULTIRATE_QUARTER_OCTAVE) shift = 2;
+    else if (NODE_OCTAVE[nodeID] <= MULTIRATE_HALF_OCTAVE) shift = 1;
+    if (NODE_RATE_FACTOR[nodeID] == 1 << shift) return;
+    NODE_RATE_FACTOR[nodeID] = 1 << shift;
+    pushAudioCommand(AudioRateClass, nodeID, (float)(1 << shift), (float)shift, 0.0f, 0.0f);
+}
+#endif
+
+#if SAMPLE_VOICES
+// root note of an octave variant, spread over the node octaves
+static int sampleRootNote(int octaveVariant)
+{
+    return MIDI_START + 12 * (octaveVariant * 2 + 1);
+}
+
+// one seamless loop: whole oscillator cycles & whole tremolo cycles
+static void renderVoiceSample(enum NodeType type, int octaveVariant, int intensityVariant)
+{
+    float freq = 440.0f * powf(2.0f, (float)(sampleRootNote(octaveVariant) - 69) / 12.0f);
+    int cycles = (int)(freq * SAMPLE_LOOP_SECONDS + 0.5f);
+    if (cycles < 1) cycles = 1;
+    int frames = (int)((float)cycles * (float)SAMPLE_RATE / freq + 0.5f);
+    float cyclesPerFrame = (float)cycles / (float)frames;
+    
+    // same mapping as the synth's amp mod at this intensity
+    float intensity = ((float)intensityVariant + 0.5f) / (float)SAMPLE_INTENSITY_VARIANTS;
+    float ampModRate = lerp(MIN_AMP_MOD_RATE, MAX_AMP_MOD_RATE, intensity);
+    float ampModDepth = lerp(MIN_AMP_MOD_DEPTH, MAX_AMP_MOD_DEPTH, intensity);
+    int modCycles = (int)(ampModRate * (float)frames / (float)SAMPLE_RATE + 0.5f);
+    if (modCycles < 1) modCycles = 1;
+    float modCyclesPerFrame = (float)modCycles / (float)frames;
+    
+    int saw = NODE_TYPE_INFO[type].waveform == kWaveformSawtooth;
+    int16_t *data = PD->system->realloc(NULL, frames * sizeof(int16_t));
+    for (int i = 0; i < frames; i++)
+    {
+        float phase = (float)i * cyclesPerFrame;
+        phase -= floorf(phase);
+        float v = saw ? 2.0f * phase - 1.0f : sinf(phase * 2.0f * 3.14159265f);
+        float modPhase = (float)i * modCyclesPerFrame;
+        float mod = 1.0f - ampModDepth * 0.5f * (1.0f - cosf((modPhase - floorf(modPhase)) * 2.0f * 3.14159265f));
+        data[i] = (int16_t)(v * mod * 0.8f * 32767.0f);
+    }
+    
+    VOICE_SAMPLE[type][octaveVariant][intensityVariant] =
+        PD->sound->sample->newSampleFromData((uint8_t *)data, kSound16bitMono, SAMPLE_RATE, frames * sizeof(int16_t));
+    VOICE_SAMPLE_FRAMES[type][octaveVariant][intensityVariant] = frames;
+}
+
+static void buildVoiceSamples(void)
+{
+    float before = PD->system->getElapsedTime();
+    int bytes = 0;
+    for (int t = Strong; t < NodeTypeCount; t++)
+    {
+        for (int o = 0; o < SAMPLE_OCTAVE_VARIANTS; o++)
+        {
+            for (int m = 0; m < SAMPLE_INTENSITY_VARIANTS; m++)
+            {
+                renderVoiceSample(t, o, m);
+                bytes += VOICE_SAMPLE_FRAMES[t][o][m] * sizeof(int16_t);
+            }
+        }
+    }
+    PD->system->logToConsole("sample voices: %d KB in %.1f ms, voice cost %.1f vs %.1f-%.1f synthesized",
+                             bytes / 1024,
+                             (double)((PD->system->getElapsedTime() - before) * 1000.0f),
+                             (double)SAMPLE_VOICE_COST,
+                             (double)WEAK_VOICE_COST,
+                             (double)(STRONG_VOICE_COST + MOD_VOICE_COST));
+}
+
+static void engineMenuChanged(void* userdata)
+{
+    (void)userdata;
+    VOICE_ENGINE = PD->system->getMenuItemValue(ENGINE_MENU) == 1 ? SampleEngine : SynthEngine;
+}
+
+// nearest pre-rendered variant, transposed so notes still land on pitch
+static void setVoiceSample(PDSynth *synth, enum NodeType type, int octave, float intensity)
+{
+    int o = octave / 2;
+    if (o > SAMPLE_OCTAVE_VARIANTS - 1) o = SAMPLE_OCTAVE_VARIANTS - 1;
+    int m = (int)(intensity * (float)SAMPLE_INTENSITY_VARIANTS);
+    if (m > SAMPLE_INTENSITY_VARIANTS - 1) m = SAMPLE_INTENSITY_VARIANTS - 1;
+    PD->sound->synth->setSample(synth, VOICE_SAMPLE[type][o][m], 0, VOICE_SAMPLE_FRAMES[type][o][m]);
+    PD->sound->synth->setTranspose(synth, (float)(SAMPLE_ROOT_NOTE - sampleRootNote(o)));
+}
+#endif
+
+// a voice off CHANNEL isn't rendered & its LFOs aren't stepped
+static void cullNode(int nodeID)
+{
+    PD->sound->channel->removeSource(CHANNEL, (SoundSource *)NODE_INSTRUMENT[nodeID]);
+    NODE_CULLED[nodeID] = 1;
+    CULLED_NODE_COUNT++;
+}
+
+static void uncullNode(int nodeID)
+{
+    PD->sound->channel->addSource(CHANNEL, (SoundSource *)NODE_INSTRUMENT[nodeID]);
+    NODE_CULLED[nodeID] = 0;
+    CULLED_NODE_COUNT--;
+}
+
+#if WATER_FIELD
+// water
+static void buildWaterDither(void)
+{
+    const int bayer[4][4] =
+    {
+        {  0,  8,  2, 10 },
+        { 12,  4, 14,  6 },
+        {  3, 11,  1,  9 },
+        { 15,  7, 13,  5 }
+    };
+    for (int level = 0; level <= 16; level++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            uint8_t nibble = 0;
+            for (int col = 0; col < 4; col++)
+            {
+                // black where the threshold falls under the level
+                if (bayer[row][col] >= level) nibble |= 0x8 >> col;
+            }
+            WATER_DITHER[level][row] = nibble;
+        }
+    }
+}
+
+static void splashWater(int x, int y, int amount)
+{
+    int col = (x >> WATER_CELL_SHIFT) + 1;
+    int row = (y >> WATER_CELL_SHIFT) + 1;
+    if (col < 1 || col > WATER_COLS || row < 1 || row > WATER_ROWS) return;
+    // keep stacked splashes well inside int16 for the step
+    int height = WATER_CURRENT[row][col] + amount;
+    WATER_CURRENT[row][col] = height > 8192 ? 8192 : height;
+}
+
+// classic two buffer ripple: new height from the neighbours, minus where it was a step ago, damped
+// straight int16 loops so they vectorise
+static void stepWater(void)
+{
+    for (int row = 1; row <= WATER_ROWS; row++)
+    {
+        const int16_t *up = WATER_CURRENT[row - 1];
+        const int16_t *here = WATER_CURRENT[row];
+        const int16_t *down = WATER_CURRENT[row + 1];
+        int16_t *next = WATER_PREVIOUS[row];
+        for (int col = 1; col <= WATER_COLS; col++)
+        {
+            int16_t v = ((here[col - 1] + here[col + 1] + up[col] + down[col]) >> 1) - next[col];
+            next[col] = v - (v >> WATER_DAMPING);
+        }
+    }
+    int16_t (*swap)[WATER_COLS + 2] = WATER_CURRENT;
+    WATER_CURRENT = WATER_PREVIOUS;
+    WATER_PREVIOUS = swap;
+}
+
+static int waterLevel(int16_t v)
+{
+    int level = (v < 0 ? -v : v) >> WATER_SHADE_SHIFT;
+    return level > 16 ? 16 : level;
+}
+
+// mark the cells whose shade changed with the step dirty, a run of changed cells per cell row at a time
+static void markWater(void)
+{
+    for (int row = 0; row < WATER_ROWS; row++)
+    {
+        const int16_t *cells = WATER_CURRENT[row + 1] + 1;
+        uint8_t *shown = WATER_SHOWN[row];
+        int first = -1;
+        int last = -1;
+        for (int col = 0; col < WATER_COLS; col++)
+        {
+            uint8_t level = waterLevel(cells[col]);
+            if (level == shown[col]) continue;
+            shown[col] = level;
+            if (first < 0) first = col;
+            last = col;
+        }
+        if (first < 0) continue;
+        PD->sprite->addDirtyRect(LCDMakeRect(first << WATER_CELL_SHIFT, row << WATER_CELL_SHIFT,
+                                             (last - first + 1) << WATER_CELL_SHIFT, 1 << WATER_CELL_SHIFT));
+    }
+}
+
+// background sprite draw, only called for the dirty parts of the screen
+// every byte of the frame covers 2 cells across, every cell 4 rows down
+static void drawWater(LCDSprite *sprite, PDRect bounds, PDRect drawrect)
+{
+    (void)sprite;
+    (void)bounds;
+    int x0 = (int)drawrect.x;
+    int y0 = (int)drawrect.y;
+    int x1 = (int)(drawrect.x + drawrect.width) - 1;
+    int y1 = (int)(drawrect.y + drawrect.height) - 1;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > LCD_COLUMNS - 1) x1 = LCD_COLUMNS - 1;
+    if (y1 > LCD_ROWS - 1) y1 = LCD_ROWS - 1;
+    if (x0 > x1 || y0 > y1) return;
+    
+    uint8_t *frame = PD->graphics->getFrame();
+    int byte0 = x0 >> 3;
+    int byte1 = x1 >> 3;
+    uint8_t mask0 = 0xFF >> (x0 & 7);
+    uint8_t mask1 = 0xFF << (7 - (x1 & 7));
+    for (int y = y0; y <= y1; y++)
+    {
+        const uint8_t *levels = WATER_SHOWN[y >> WATER_CELL_SHIFT];
+        int bayerRow = y & 3;
+        uint8_t *out = frame + y * LCD_ROWSIZE;
+        for (int b = byte0; b <= byte1; b++)
+        {
+            uint8_t pixels = (WATER_DITHER[levels[b * 2]][bayerRow] << 4) | WATER_DITHER[levels[b * 2 + 1]][bayerRow];
+            uint8_t mask = 0xFF;
+            if (b == byte0) mask &= mask0;
+            if (b == byte1) mask &= mask1;
+            out[b] = (out[b] & ~mask) | (pixels & mask);
+        }
+    }
+    PD->graphics->markUpdatedRows(y0, y1);
+}
+
+// a full screen sprite under everything else
+static void addWaterSprite(void)
+{
+    const struct playdate_sprite *sprite = PD->sprite;
+    WATER_SPRITE = sprite->newSprite();
+    sprite->setBounds(WATER_SPRITE, PDRectMake(0.0f, 0.0f, (float)LCD_COLUMNS, (float)LCD_ROWS));
+    sprite->setDrawFunction(WATER_SPRITE, drawWater);
+    sprite->setZIndex(WATER_SPRITE, -32768);
+    sprite->setOpaque(WATER_SPRITE, 1);
+    sprite->setIgnoresDrawOffset(WATER_SPRITE, 1);
+    sprite->addSprite(WATER_SPRITE);
+}
+
+#if WATER_BENCH
+static void benchWater(void)
+{
+    for (int i = 0; i < 8; i++) splashWater(rand() % LCD_COLUMNS, rand() % LCD_ROWS, WATER_SPLASH);
+    
+    PD->system->resetElapsedTime();
+    for (int run = 0; run < WATER_BENCH_RUNS; run++) stepWater();
+    float step = PD->system->getElapsedTime();
+    
+    PD->system->resetElapsedTime();
+    for (int run = 0; run < WATER_BENCH_RUNS; run++) markWater();
+    float mark = PD->system->getElapsedTime();
+    
+    // the worst case, every cell changed
+    PDRect screen = PDRectMake(0.0f, 0.0f, (float)LCD_COLUMNS, (float)LCD_ROWS);
+    PD->system->resetElapsedTime();
+    for (int run = 0; run < WATER_BENCH_RUNS; run++) drawWater(NULL, screen, screen);
+    float draw = PD->system->getElapsedTime();
+    
+    PD->system->logToConsole("water: step %.3f ms, mark %.3f ms, full screen dither %.3f ms per frame",
+                             (double)(step * 1000.0f / (float)WATER_BENCH_RUNS),
+                             (double)(mark * 1000.0f / (float)WATER_BENCH_RUNS),
+                             (double)(draw * 1000.0f / (float)WATER_BENCH_RUNS));
+}
+#endif
+#endif
+
+#if PARAM_SWEEP
+static void sweepNote(int pitch)
+{
+    SWEEP_NOTES++;
+    SWEEP_PITCH_CLASS[pitch % 12]++;
+}
+#endif
+
+#if MIDI_EXPORT
+static void flushMidi(void)
+{
+    if (MIDI_BUFFER_USED == 0) return;
+    if (PD->file->write(MIDI_FILE, MIDI_BUFFER, MIDI_BUFFER_USED) < 0) ERR = PD->file->geterr();
+    MIDI_TRACK_BYTES += MIDI_BUFFER_USED;
+    MIDI_BUFFER_USED = 0;
+    MIDI_WRITES++;
+}
+
+// delta time as a variable length quantity, then the event
+static void midiEvent(uint64_t time, uint8_t status, uint8_t data1, uint8_t data2)
+{
+    if (MIDI_BUFFER_USED > MIDI_BUFFER_SIZE - 8) flushMidi();
+    
+    uint64_t tick = time * MIDI_TICKS_PER_SECOND / SAMPLE_RATE;
+    uint32_t delta = tick > MIDI_LAST_TICK ? (uint32_t)(tick - MIDI_LAST_TICK) : 0;
+    if (tick > MIDI_LAST_TICK) MIDI_LAST_TICK = tick;
+    if (delta > 0x0FFFFFFF) delta = 0x0FFFFFFF;
+    uint8_t *out = MIDI_BUFFER + MIDI_BUFFER_USED;
+    int shift = 21;
+    while (shift > 0 && (delta >> shift) == 0) shift -= 7;
+    for (; shift > 0; shift -= 7) *out++ = 0x80 | ((delta >> shift) & 0x7F);
+    *out++ = delta & 0x7F;
+    *out++ = status;
+    *out++ = data1;
+    *out++ = data2;
+    MIDI_BUFFER_USED = (int)(out - MIDI_BUFFER);
+    MIDI_EVENTS++;
+}
+
+// note offs go out lazily, in time order, before any later event
+// node IDs onto the 15 melodic channels, channel 10 (9 from 0) is percussion in General MIDI
+static uint8_t midiChannel(int nodeID)
+{
+    int channel = nodeID % 15;
+    return channel < 9 ? channel : channel + 1;
+}
+
+static void midiNoteOffsUntil(uint64_t time)
+{
+    for (;;)
+    {
+        int next = -1;
+        int nextVoice = 0;
+        for (int i = 0; i < MAX_NODES; i++)
+        {
+            for (int v = 0; v < NODE_MAX_VOICES; v++)
+            {
+                if (MIDI_NOTE_OFF[i][v] == 0 || MIDI_NOTE_OFF[i][v] > time) continue;
+                if (next == -1 || MIDI_NOTE_OFF[i][v] < MIDI_NOTE_OFF[next][nextVoice]) { next = i; nextVoice = v; }
+            }
+        }
+        if (next == -1) return;
+        midiEvent(MIDI_NOTE_OFF[next][nextVoice], 0x80 | midiChannel(next), MIDI_NOTE[next][nextVoice], 0);
+        MIDI_NOTE_OFF[next][nextVoice] = 0;
+    }
+}
+
+// end a node's sounding notes now, as the instrument does when the node is freed
+static void midiReleaseNode(int nodeID)
+{
+    for (int v = 0; v < NODE_MAX_VOICES; v++)
+    {
+        if (MIDI_NOTE_OFF[nodeID][v] > CURRENT_TIME) MIDI_NOTE_OFF[nodeID][v] = CURRENT_TIME;
+    }
+}
+
+// notes overlap like the node's instrument plays them, on up to its type's voices, the oldest cut short after that
+// (a key that's still down is ended first instead, a channel can't hold the same key twice)
+static void midiNoteOn(int nodeID, int pitch, float velocity, float len)
+{
+    if (MIDI_FILE == NULL) return;
+    midiNoteOffsUntil(CURRENT_TIME);
+    if (pitch > 127) pitch = 127;
+    int voices = NODE_TYPE_INFO[NODE_TYPE[nodeID]].voices;
+    int voice = -1;
+    for (int v = 0; v < voices && voice == -1; v++)
+    {
+        if (MIDI_NOTE_OFF[nodeID][v] != 0 && MIDI_NOTE[nodeID][v] == pitch) voice = v;
+    }
+    for (int v = 0; v < voices && voice == -1; v++)
+    {
+        if (MIDI_NOTE_OFF[nodeID][v] == 0) voice = v;
+    }
+    if (voice == -1)
+    {
+        voice = 0;
+        for (int v = 1; v < voices; v++) { if (MIDI_NOTE_ON[nodeID][v] < MIDI_NOTE_ON[nodeID][voice]) voice = v; }
+    }
+    if (MIDI_NOTE_OFF[nodeID][voice] != 0)
+    {
+        midiEvent(CURRENT_TIME, 0x80 | midiChannel(nodeID), MIDI_NOTE[nodeID][voice], 0);
+        MIDI_NOTE_OFF[nodeID][voice] = 0;
+    }
+    
+    int vel = (int)(velocity * 127.0f);
+    if (vel > 127) vel = 127;
+    if (vel < 1) vel = 1;
+    midiEvent(CURRENT_TIME, 0x90 | midiChannel(nodeID), (uint8_t)pitch, (uint8_t)vel);
+    MIDI_NOTE[nodeID][voice] = (uint8_t)pitch;
+    MIDI_NOTE_ON[nodeID][voice] = CURRENT_TIME;
+    MIDI_NOTE_OFF[nodeID][voice] = CURRENT_TIME + 1 + (uint64_t)(len * (float)SAMPLE_RATE);
+}
+
+// format 0, one track, its length patched in on close
+static void startMidiExport(void)
+{
+    char *name = NULL;
+    PD->system->formatString(&name, "ripplesynth-%u.mid", PD->system->getSecondsSinceEpoch(NULL));
+    MIDI_FILE = PD->file->open(name, kFileWrite);
+    PD->system->realloc(name, 0);
+    if (MIDI_FILE == NULL)
+    {
+        ERR = PD->file->geterr();
+        PD->system->setMenuItemValue(MIDI_MENU, 0);
+        return;
+    }
+    
+    const uint8_t header[22] = {
+        'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1,
+        MIDI_TICKS_PER_QUARTER >> 8, MIDI_TICKS_PER_QUARTER & 0xFF,
+        'M', 'T', 'r', 'k', 0, 0, 0, 0
+    };
+    PD->file->write(MIDI_FILE, header, sizeof(header));
+    MIDI_BUFFER_USED = 0;
+    MIDI_TRACK_BYTES = 0;
+    MIDI_EVENTS = 0;
+    MIDI_WRITES = 0;
+    MIDI_LAST_TICK = CURRENT_TIME * MIDI_TICKS_PER_SECOND / SAMPLE_RATE;
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        for (int v = 0; v < NODE_MAX_VOICES; v++) MIDI_NOTE_OFF[i][v] = 0;
+    }
+}
+
+static void stopMidiExport(void)
+{
+    if (MIDI_FILE == NULL) return;
+    midiNoteOffsUntil(UINT64_MAX);
+    // end of track
+    midiEvent(MIDI_LAST_TICK * SAMPLE_RATE / MIDI_TICKS_PER_SECOND, 0xFF, 0x2F, 0x00);
+    flushMidi();
+    
+    const uint8_t length[4] = {
+        MIDI_TRACK_BYTES >> 24, (MIDI_TRACK_BYTES >> 16) & 0xFF, (MIDI_TRACK_BYTES >> 8) & 0xFF, MIDI_TRACK_BYTES & 0xFF
+    };
+    PD->file->seek(MIDI_FILE, 18, SEEK_SET);
+    PD->file->write(MIDI_FILE, length, sizeof(length));
+    PD->file->close(MIDI_FILE);
+    MIDI_FILE = NULL;
+    PD->system->logToConsole("midi export: %d events, %u bytes in %d writes", MIDI_EVENTS, MIDI_TRACK_BYTES, MIDI_WRITES);
+}
+
+static void midiMenuChanged(void* userdata)
+{
+    (void)userdata;
+    if (PD->system->getMenuItemValue(MIDI_MENU)) { if (MIDI_FILE == NULL) startMidiExport(); }
+    else stopMidiExport();
+}
+#endif
+
+static void pulseNode(int nodeID)
+{
+    int fieldPitch;
+    int pitch;
+    struct PitchSet set = PITCH_SETS[NODE_PITCH_SET[nodeID]];
+    if (takeRand() % 10 > RARE_PITCH_ODDS)
+    {
+        fieldPitch = PITCH_FIELD.pitches[set.common[takeRand() % set.commonCount]];
+    } else {
+        fieldPitch = PITCH_FIELD.pitches[set.rare[takeRand() % set.rareCount]];
+    }
+    pitch = MIDI_START + fieldPitch + 12 * NODE_OCTAVE[nodeID];
+    float velocity = lerp(0.5f, 1.0f, (float)(takeRand() % 100) * 0.03);
+    if (NODE_CULLED[nodeID]) uncullNode(nodeID);
+    // an earlier, longer note can still be ringing on another voice
+    uint64_t soundingUntil = CURRENT_TIME + (uint64_t)((NODE_LEN[nodeID] + NODE_RELEASE[nodeID]) * (float)SAMPLE_RATE);
+    if (soundingUntil > NODE_SOUNDING_UNTIL[nodeID]) NODE_SOUNDING_UNTIL[nodeID] = soundingUntil;
+    PD->sound->instrument->playMIDINote(
+                                        NODE_INSTRUMENT[nodeID],
+                                        pitch,
+                                        velocity,
+                                        NODE_LEN[nodeID],
+                                        0
+                                        );
+    pushAudioCommand(AudioNoteOn, nodeID, (float)pitch, velocity, NODE_LEN[nodeID], 0.0f);
+#if MIDI_EXPORT
+    midiNoteOn(nodeID, pitch, velocity, NODE_LEN[nodeID]);
+#endif
+#if PARAM_SWEEP
+    sweepNote(pitch);
+#endif
+    spawnRipple(NODE_X[nodeID], NODE_Y[nodeID]);
+#if WATER_FIELD
+    splashWater(NODE_X[nodeID], NODE_Y[nodeID], (int)((float)WATER_SPLASH * velocity));
+#endif
+    float salt = (float)(takeRand() % 1000);
+    // only the offset is float, added to the clock in whole samples
+    float offset = NODE_PULSE_MOD[nodeID] * PULSE_MOD_SCALE * lerp(SLOW_BASE_PULSE, HIGH_BASE_PULSE, BASE_PULSE) + salt;
+    NODE_NEXT_PULSE[nodeID] = CURRENT_TIME + (uint64_t)offset;
+#if SOAK_TEST
+    // the interval as it lands on the clock has to be one the pulse parameters allow
+    // (a sample of slack either way for the float math, the salt is under 1000)
+    float span = PULSE_MOD_SCALE * lerp(SLOW_BASE_PULSE, HIGH_BASE_PULSE, BASE_PULSE);
+    uint64_t shortest = (uint64_t)(BASE_PULSE * NODE_MIN_PULSE_MOD * span) - 1;
+    uint64_t longest = (uint64_t)(NODE_MAX_PULSE_MOD * span) + 1000;
+    uint64_t interval = NODE_NEXT_PULSE[nodeID] - CURRENT_TIME;
+    if (interval < shortest || interval > longest)
+    {
+        PD->system->error("soak: node %d pulse due in %lld samples, expected %lld to %lld", nodeID,
+                          (long long)(int64_t)interval, (long long)shortest, (long long)longest);
+    }
+#endif
+    scheduleTimer(nodeID * NodeTimerCount + PulseTimer, NODE_NEXT_PULSE[nodeID]);
+}
+
+// gather what the batch needs from a node & the API
+static void gatherNodeParams(struct ParamBatch *batch, int i, int nodeID)
+{
+    float x, y;
+    PD->sprite->getPosition(NODE_SPRITE[nodeID], &x, &y);
+    batch->nodeID[i] = nodeID;
+    batch->x[i] = x;
+    batch->y[i] = y;
+    batch->nodeCloseness[i] = closenessToOtherNodes(nodeID);
+    
+    // positional parameters come straight out of the spatial map
+    int col = spatialCell(x, SPATIAL_COLS);
+    int row = spatialCell(y, SPATIAL_ROWS);
+    batch->centerCloseness[i] = (float)SPATIAL_MAP->centerCloseness[row][col] * (1.0f / 255.0f);
+    batch->leftPan[i] = (float)SPATIAL_MAP->leftPan[col] * (1.0f / 255.0f);
+    batch->octave[i] = SPATIAL_MAP->octave[row];
+    batch->age[i] = (float)(CURRENT_TIME - (NODE_DEATH_TIME[nodeID] - NODE_LIFESPAN[nodeID]));
+    batch->lifespan[i] = (float)NODE_LIFESPAN[nodeID];
+    batch->timeLeft[i] = (float)(int64_t)(NODE_DEATH_TIME[nodeID] - CURRENT_TIME);
+}
+
+// derive every node parameter for a run of the batch
+// pure & branch free over packed arrays so the compiler can vectorise it
+static void computeNodeParams(struct ParamBatch *restrict batch, int first, int count, const struct NodeTypeInfo *info)
+{
+    const float basePulse = BASE_PULSE;
+    const float inverseFadeBuffer = INVERSE_FADE_BUFFER;
+    const float voiceCost = info->voiceCost;
+    const float minAttack = info->minAttack, maxAttack = info->maxAttack;
+    const float minDecay = info->minDecay, maxDecay = info->maxDecay;
+    const float minSustain = info->minSustain, maxSustain = info->maxSustain;
+    const float minRelease = info->minRelease, maxRelease = info->maxRelease;
+    const float minPulseMod = info->minPulseMod, maxPulseMod = info->maxPulseMod;
+    
+    for (int i = first; i < first + count; i++)
+    {
+        float nodeCloseness = batch->nodeCloseness[i];
+        
+        // timbre
+        // closeness to other nodes = more intense
+        float modAlpha = 1.0f - nodeCloseness;
+        batch->freqModRate[i] = lerp(MIN_FREQ_MOD_RATE, MAX_FREQ_MOD_RATE, modAlpha);
+        batch->freqModPhase[i] = lerp(MIN_FREQ_MOD_PHASE, MAX_FREQ_MOD_PHASE, modAlpha);
+        batch->freqModDepth[i] = lerp(MIN_FREQ_MOD_DEPTH, MAX_FREQ_MOD_DEPTH, modAlpha);
+        batch->ampModRate[i] = lerp(MIN_AMP_MOD_RATE, MAX_AMP_MOD_RATE, modAlpha);
+        batch->ampModPhase[i] = lerp(MIN_AMP_MOD_PHASE, MAX_AMP_MOD_PHASE, modAlpha);
+        batch->ampModDepth[i] = lerp(MIN_AMP_MOD_DEPTH, MAX_AMP_MOD_DEPTH, modAlpha);
+        
+        // deeper, faster modulation = more expensive voice
+        batch->cost[i] = voiceCost + MOD_VOICE_COST * modAlpha;
+        
+        // envelope
+        // node type 1 = harsher
+        // less life left = smoother
+        float envAlpha = batch->age[i] / batch->lifespan[i];
+        batch->attack[i] = lerp(minAttack, maxAttack, envAlpha);
+        batch->decay[i] = lerp(minDecay, maxDecay, envAlpha);
+        batch->sustain[i] = lerp(minSustain, maxSustain, envAlpha);
+        batch->release[i] = lerp(minRelease, maxRelease, envAlpha);
+        
+        // volume
+        // closeness to other nodes = louder
+        // slight hairpin in and fadeout with lifetime (can replace the whole fadeout mechanic probably)
+        float lifespanAlpha = batch->timeLeft[i] * inverseFadeBuffer;
+        lifespanAlpha = lifespanAlpha < 1.0f ? lifespanAlpha : 1.0f;
+        float baseVol = lifespanAlpha * (0.8f * nodeCloseness + 0.2f);
+        float leftPan = batch->leftPan[i];
+        batch->volumeL[i] = baseVol * leftPan;
+        batch->volumeR[i] = baseVol * (1.0f - leftPan);
+        
+        // length
+        // closeness to center = shorter
+        float centerCloseness = batch->centerCloseness[i];
+        batch->len[i] = lerp(NODE_MIN_LEN, NODE_MAX_LEN, 1.0f - centerCloseness);
+        
+        // pulse
+        // closeness to center = faster
+        batch->pulseMod[i] = basePulse * lerp(maxPulseMod, minPulseMod, centerCloseness);
+    }
+}
+
+// push a computed batch entry out to the node & the API
+static void submitNodeParams(const struct ParamBatch *batch, int i)
+{
+    int nodeID = batch->nodeID[i];
+    const struct playdate_sound_synth *pdSynth = PD->sound->synth;
+    const struct playdate_sound_lfo *pdLFO = PD->sound->lfo;
+    enum NodeType type = NODE_TYPE[nodeID];
+    
+    for (int v = 0; v < NODE_TYPE_INFO[type].voices; v++)
+    {
+        PDSynth *synth = TYPE_VOICE[type][NODE_POOL_ENTRY[nodeID]][v];
+        
+        // timbre (baked into the loop for sample voices)
+        if (NODE_ENGINE[nodeID] == SynthEngine)
+        {
+            PDSynthLFO *freqMod = TYPE_FREQ_MOD[type][NODE_POOL_ENTRY[nodeID]][v];
+            pdLFO->setRate(freqMod, batch->freqModRate[i]);
+            pdLFO->setPhase(freqMod, batch->freqModPhase[i]);
+            pdLFO->setDepth(freqMod, batch->freqModDepth[i]);
+            PDSynthLFO *ampMod = TYPE_AMP_MOD[type][NODE_POOL_ENTRY[nodeID]][v];
+            pdLFO->setRate(ampMod, batch->ampModRate[i]);
+            pdLFO->setPhase(ampMod, batch->ampModPhase[i]);
+            pdLFO->setDepth(ampMod, batch->ampModDepth[i]);
+        }
+        
+        // envelope
+        pdSynth->setAttackTime(synth, batch->attack[i]);
+        pdSynth->setDecayTime(synth, batch->decay[i]);
+        pdSynth->setSustainLevel(synth, batch->sustain[i]);
+        pdSynth->setReleaseTime(synth, batch->release[i]);
+    }
+    NODE_RELEASE[nodeID] = batch->release[i];
+    pushAudioCommand(AudioEnvelope, nodeID, batch->attack[i], batch->decay[i], batch->sustain[i], batch->release[i]);
+    
+    // volume
+    PD->sound->instrument->setVolume(NODE_INSTRUMENT[nodeID], batch->volumeL[i], batch->volumeR[i]);
+    pushAudioCommand(AudioVolume, nodeID, batch->volumeL[i], batch->volumeR[i], 0.0f, 0.0f);
+    
+    // cull voices that can't be heard & have finished sounding, bring them back once they could be
+    // (the telemetry lags a frame or so behind a new note, so the last note has to be over too)
+    int audible = batch->volumeL[i] + batch->volumeR[i] >= AUDIBLE_THRESHOLD;
+    int idle = CURRENT_TIME > NODE_SOUNDING_UNTIL[nodeID] && TELEMETRY_VIEW.envelope[nodeID] < IDLE_ENVELOPE;
+    if (NODE_CULLED[nodeID] && audible) uncullNode(nodeID);
+    else if (!NODE_CULLED[nodeID] && !audible && idle) cullNode(nodeID);
+    NODE_COST[nodeID] = NODE_CULLED[nodeID] ? 0.0f : NODE_ENGINE[nodeID] == SampleEngine ? SAMPLE_VOICE_COST : batch->cost[i];
+    
+    // octave, length & pulse
+    NODE_OCTAVE[nodeID] = batch->octave[i];
+#if MULTIRATE_VOICES
+    setRateClass(nodeID);
+#endif
+    NODE_LEN[nodeID] = batch->len[i];
+    NODE_PULSE_MOD[nodeID] = batch->pulseMod[i];
+}
+
+// nudge a touched node up to half a pixel either way, wrapping at the screen edges
+static void jitterNode(const struct ParamBatch *batch, int i)
+{
+    int nodeID = batch->nodeID[i];
+    float x = batch->x[i];
+    float y = batch->y[i];
+    x += (float)(takeRand() % 2) - 0.5f;
+    y += (float)(takeRand() % 2) - 0.5f;
+    if (x > (float)LCD_COLUMNS) x -= (float)LCD_COLUMNS;
+    if (y > (float)LCD_ROWS) y -= (float)LCD_ROWS;
+    if (x < 0.0f) x += (float)LCD_COLUMNS;
+    if (y < 0.0f) y += (float)LCD_ROWS;
+    PD->sprite->moveTo(NODE_SPRITE[nodeID], x, y);
+    NODE_X[nodeID] = x;
+    NODE_Y[nodeID] = y;
+}
+
+// derive & apply the sound parameters for a batch of nodes where they stand, returns how many were batched
+static int setNodeParams(const int *nodeIDs, int count)
+{
+    // grouped by type so each group runs with its type's constants
+    // (nodes can die between being queued & touched, those drop out here)
+    int batched = 0;
+    for (enum NodeType t = Strong; t < NodeTypeCount; t++)
+    {
+        int first = batched;
+        for (int i = 0; i < count; i++)
+        {
+            if (NODE_TYPE[nodeIDs[i]] == t) gatherNodeParams(&PARAM_BATCH, batched++, nodeIDs[i]);
+        }
+        if (batched > first) computeNodeParams(&PARAM_BATCH, first, batched - first, &NODE_TYPE_INFO[t]);
+    }
+    for (int i = 0; i < batched; i++) submitNodeParams(&PARAM_BATCH, i);
+    return batched;
+}
+
+// update node sound and management for a batch of nodes
+// (death and pulses are timer events of their own)
+static void touchNodes(const int *nodeIDs, int count)
+{
+    int batched = setNodeParams(nodeIDs, count);
+    for (int i = 0; i < batched; i++) jitterNode(&PARAM_BATCH, i);
+}
+
+static void touchNode(int nodeID) { touchNodes(&nodeID, 1); }
+
+#if BATCH_BENCH
+// the parameter math as touchNode did it before the batch split, one node at a time,
+// branching on type per node & writing straight out to that node's state
+struct ScalarNodeParams
+{
+    float freqModRate, freqModPhase, freqModDepth;
+    float ampModRate, ampModPhase, ampModDepth;
+    float cost;
+    float attack, decay, sustain, release;
+    float volumeL, volumeR;
+    float len;
+    float pulseMod;
+};
+static struct ScalarNodeParams SCALAR_NODE_PARAMS[PARAM_BATCH_CAPACITY];
+
+static void scalarNodeParams(const struct ParamBatch *batch, int i, enum NodeType type)
+{
+    struct ScalarNodeParams *out = &SCALAR_NODE_PARAMS[i];
+    float nodeCloseness = batch->nodeCloseness[i];
+    
+    float freqModAlpha = 1.0f - nodeCloseness;
+    out->freqModRate = lerp(MIN_FREQ_MOD_RATE, MAX_FREQ_MOD_RATE, freqModAlpha);
+    out->freqModPhase = lerp(MIN_FREQ_MOD_PHASE, MAX_FREQ_MOD_PHASE, freqModAlpha);
+    out->freqModDepth = lerp(MIN_FREQ_MOD_DEPTH, MAX_FREQ_MOD_DEPTH, freqModAlpha);
+    float ampModAlpha = 1.0f - nodeCloseness;
+    out->ampModRate = lerp(MIN_AMP_MOD_RATE, MAX_AMP_MOD_RATE, ampModAlpha);
+    out->ampModPhase = lerp(MIN_AMP_MOD_PHASE, MAX_AMP_MOD_PHASE, ampModAlpha);
+    out->ampModDepth = lerp(MIN_AMP_MOD_DEPTH, MAX_AMP_MOD_DEPTH, ampModAlpha);
+    out->cost = (type == Strong ? NODE_TYPE_INFO[Strong].voiceCost : NODE_TYPE_INFO[Weak].voiceCost) + MOD_VOICE_COST * ampModAlpha;
+    
+    float envAlpha = batch->age[i] / batch->lifespan[i];
+    if (type == Strong)
+    {
+        out->attack = lerp(NODE_TYPE_INFO[Strong].minAttack, NODE_TYPE_INFO[Strong].maxAttack, envAlpha);
+        out->decay = lerp(NODE_TYPE_INFO[Strong].minDecay, NODE_TYPE_INFO[Strong].maxDecay, envAlpha);
+        out->sustain = lerp(NODE_TYPE_INFO[Strong].minSustain, NODE_TYPE_INFO[Strong].maxSustain, envAlpha);
+        out->release = lerp(NODE_TYPE_INFO[Strong].minRelease, NODE_TYPE_INFO[Strong].maxRelease, envAlpha);
+    }
+    else
+    {
+        out->attack = lerp(NODE_TYPE_INFO[Weak].minAttack, NODE_TYPE_INFO[Weak].maxAttack, envAlpha);
+        out->decay = lerp(NODE_TYPE_INFO[Weak].minDecay, NODE_TYPE_INFO[Weak].maxDecay, envAlpha);
+        out->sustain = lerp(NODE_TYPE_INFO[Weak].minSustain, NODE_TYPE_INFO[Weak].maxSustain, envAlpha);
+        out->release = lerp(NODE_TYPE_INFO[Weak].minRelease, NODE_TYPE_INFO[Weak].maxRelease, envAlpha);
+    }
+    
+    float lifespanAlpha = 1.0f;
+    if (batch->timeLeft[i] < (float)NODE_FADE_BUFFER) lifespanAlpha = batch->timeLeft[i] * INVERSE_FADE_BUFFER;
+    float baseVol = lifespanAlpha * (0.8f * nodeCloseness + 0.2f);
+    float leftPan = batch->leftPan[i];
+    out->volumeL = lerp(0.0f, baseVol, leftPan);
+    out->volumeR = lerp(0.0f, baseVol, 1.0f - leftPan);
+    
+    float centerCloseness = batch->centerCloseness[i];
+    out->len = lerp(NODE_MIN_LEN, NODE_MAX_LEN, 1.0f - centerCloseness);
+    out->pulseMod = BASE_PULSE * lerp(NODE_TYPE_INFO[type].maxPulseMod, NODE_TYPE_INFO[type].minPulseMod, centerCloseness);
+}
+
+// compare one batched pass against the pre-split node-at-a-time math over the same inputs
+// (parameter math only, neither side gathers inputs or calls the API)
+static void benchNodeParams(void)
+{
+    const int counts[3] = { 12, 64, 256 };
+    for (int i = 0; i < PARAM_BATCH_CAPACITY; i++)
+    {
+        PARAM_BATCH.x[i] = (float)(rand() % LCD_COLUMNS);
+        PARAM_BATCH.y[i] = (float)(rand() % LCD_ROWS);
+        PARAM_BATCH.nodeCloseness[i] = (float)(rand() % 100) * 0.01f;
+        PARAM_BATCH.centerCloseness[i] = (float)(rand() % 100) * 0.01f;
+        PARAM_BATCH.leftPan[i] = PARAM_BATCH.x[i] / (float)LCD_COLUMNS;
+        PARAM_BATCH.lifespan[i] = (float)NODE_LIFETIME;
+        PARAM_BATCH.age[i] = (float)(rand() % NODE_LIFETIME);
+        PARAM_BATCH.timeLeft[i] = PARAM_BATCH.lifespan[i] - PARAM_BATCH.age[i];
+    }
+    
+    for (int c = 0; c < 3; c++)
+    {
+        int count = counts[c];
+        
+        PD->system->resetElapsedTime();
+        for (int run = 0; run < BATCH_BENCH_RUNS; run++)
+        {
+            for (int i = 0; i < count; i++) scalarNodeParams(&PARAM_BATCH, i, Strong);
+        }
+        float scalar = PD->system->getElapsedTime();
+        
+        PD->system->resetElapsedTime();
+        for (int run = 0; run < BATCH_BENCH_RUNS; run++) computeNodeParams(&PARAM_BATCH, 0, count, &NODE_TYPE_INFO[Strong]);
+        float batched = PD->system->getElapsedTime();
+        
+        PD->system->logToConsole("node params x%d: %.2f us node at a time, %.2f us batched (%.1fx)",
+                                 count,
+                                 (double)(scalar * 1000000.0f / (float)BATCH_BENCH_RUNS),
+                                 (double)(batched * 1000000.0f / (float)BATCH_BENCH_RUNS),
+                                 (double)(scalar / batched));
+    }
+}
+#endif
+
+// node sprites follow each voice's held peak (frame) & level (size), reported by the audio side
+static void animateNodes(void)
+{
+    readTelemetry();
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        if (NODE_TYPE[i] == Dead) continue;
+        float peak = TELEMETRY_VIEW.peak[i];
+        if (peak > 1.0f) peak = 1.0f;
+        int animState = (int)(peak * 7.0f + 0.5f);
+        float level = TELEMETRY_VIEW.level[i];
+        if (level > 1.0f) level = 1.0f;
+        int size = (int)(level * (float)(NODE_SIZES - 1) + 0.5f);
+        if (animState == NODE_ANIM_STATE[i] && size == NODE_ANIM_SIZE[i]) continue;
+        
+        NODE_ANIM_STATE[i] = animState;
+        NODE_ANIM_SIZE[i] = size;
+        PD->sprite->setImage(NODE_SPRITE[i], NODE_SIZED_BMT[NODE_TYPE[i]][animState][size], kBitmapUnflipped);
+    }
+}
+
+// every type's pool of instruments & voices, so nodes never allocate synths
+static void buildNodeVoices(void)
+{
+    const struct playdate_sound *pdSound = PD->sound;
+    int instrumentCount = 0;
+    int synthCount = 0;
+    for (int t = Strong; t < NodeTypeCount; t++)
+    {
+        const struct NodeTypeInfo *info = &NODE_TYPE_INFO[t];
+        TYPE_POOL_FREE_COUNT[t] = 0;
+        for (int n = info->poolSize - 1; n >= 0; n--)
+        {
+            TYPE_POOL_FREE[t][TYPE_POOL_FREE_COUNT[t]++] = n;
+            instrumentCount++;
+            PDSynthInstrument *instrument = pdSound->instrument->newInstrument();
+            TYPE_INSTRUMENT[t][n] = instrument;
+            for (int v = 0; v < info->voices; v++)
+            {
+                PDSynth *synth = pdSound->synth->newSynth();
+                pdSound->synth->setWaveform(synth, info->waveform);
+                PDSynthLFO *freqMod = pdSound->lfo->newLFO(info->modShape);
+                PDSynthLFO *ampMod = pdSound->lfo->newLFO(info->modShape);
+                pdSound->lfo->setCenter(freqMod, 0.5f);
+                pdSound->lfo->setCenter(ampMod, 0.5f);
+                TYPE_VOICE[t][n][v] = synth;
+                TYPE_FREQ_MOD[t][n][v] = freqMod;
+                TYPE_AMP_MOD[t][n][v] = ampMod;
+                pdSound->instrument->addVoice(instrument, synth, 0, 127, 0.0f);
+                synthCount++;
+            }
+        }
+    }
+    PD->system->logToConsole("node voices: %d synths over %d instruments", synthCount, instrumentCount);
+}
+
+// a node's voice & sprite, in a free slot
+static void initNode(int nodeID, enum NodeType type, int X, int Y)
+{
+    NODE_TYPE[nodeID] = type;
+    NODE_NEED_TOUCH[nodeID] = 1;
+    int gridX = gridScaleInt(X);
+    int gridY = gridScaleInt(Y);
+    NODE_GRID_X[nodeID] = gridX;
+    NODE_GRID_Y[nodeID] = gridY;
+    GRID_POINT_NODE_COUNT[gridY][gridX] += 1;
+    
+    // node sound, on an instrument from the type's pool
+    // (makeNode makes sure there's one free & no snapshot that passed validSession holds more of a type than its pool)
+    const struct playdate_sound *pdSound = PD->sound;
+    const struct NodeTypeInfo *info = &NODE_TYPE_INFO[type];
+    int entry = TYPE_POOL_FREE[type][--TYPE_POOL_FREE_COUNT[type]];
+    NODE_POOL_ENTRY[nodeID] = entry;
+    NODE_INSTRUMENT[nodeID] = TYPE_INSTRUMENT[type][entry];
+    NODE_ENGINE[nodeID] = VOICE_ENGINE;
+#if SAMPLE_VOICES
+    int row = spatialCell(Y, SPATIAL_ROWS);
+    float intensity = 1.0f - closenessToOtherNodes(nodeID);
+#endif
+#if MULTIRATE_VOICES
+    NODE_RATE_FACTOR[nodeID] = 0;
+#endif
+    for (int v = 0; v < info->voices; v++)
+    {
+        PDSynth *synth = TYPE_VOICE[type][entry][v];
+#if SAMPLE_VOICES
+        if (VOICE_ENGINE == SampleEngine)
+        {
+            setVoiceSample(synth, type, SPATIAL_MAP->octave[row], intensity);
+            pdSound->synth->setFrequencyModulator(synth, NULL);
+            pdSound->synth->setAmplitudeModulator(synth, NULL);
+            continue;
+        }
+        pdSound->synth->setTranspose(synth, 0.0f);
+#endif
+#if MULTIRATE_VOICES
+        if (info->subRate)
+        {
+            pdSound->synth->setGenerator(synth, 0, subRateRender, subRateNoteOn, subRateRelease, subRateSetParameter, subRateDealloc, &SUBRATE_VOICE[nodeID][v]);
+        }
+        else
+#endif
+        pdSound->synth->setWaveform(synth, info->waveform);
+        pdSound->synth->setFrequencyModulator(synth, (PDSynthSignalValue *)TYPE_FREQ_MOD[type][entry][v]);
+        pdSound->synth->setAmplitudeModulator(synth, (PDSynthSignalValue *)TYPE_AMP_MOD[type][entry][v]);
+    }
+    NODE_PULSE_MOD[nodeID] = lerp(NODE_TYPE_INFO[type].minPulseMod, NODE_TYPE_INFO[type].maxPulseMod, 0.5f);
+    NODE_PITCH_SET[nodeID] = SPATIAL_MAP->quadrant[spatialCell(Y, SPATIAL_ROWS)][spatialCell(X, SPATIAL_COLS)];
+    pdSound->channel->addSource(CHANNEL, (SoundSource *)NODE_INSTRUMENT[nodeID]);
+    NODE_CULLED[nodeID] = 0;
+    NODE_RELEASE[nodeID] = 0.0f;
+    NODE_SOUNDING_UNTIL[nodeID] = 0;
+    pushAudioCommand(AudioVoiceClaim, nodeID, 0.0f, 0.0f, 0.0f, 0.0f);
+    
+    // node sprite
+    const struct playdate_sprite *sprite = PD->sprite;
+    NODE_SPRITE[nodeID] = sprite->copy(NODE_SPRITE_MASTER[type]);
+    sprite->moveTo(NODE_SPRITE[nodeID], X, Y);
+    NODE_X[nodeID] = X;
+    NODE_Y[nodeID] = Y;
+    sprite->addSprite(NODE_SPRITE[nodeID]);
+    NODE_ANIM_STATE[nodeID] = 0;
+    NODE_ANIM_SIZE[nodeID] = -1;
+}
+
+// the node of a type that was made longest ago
+static int oldestNodeOfType(enum NodeType type)
+{
+    int oldest = -1;
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        if (NODE_TYPE[i] != type) continue;
+        if (oldest == -1 || NODE_DEATH_TIME[i] - NODE_LIFESPAN[i] < NODE_DEATH_TIME[oldest] - NODE_LIFESPAN[oldest]) oldest = i;
+    }
+    return oldest;
+}
+
+static void makeNode(enum NodeType type, int X, int Y)
+{
+    // every instrument of this type is out, so the type's oldest node makes way & its instrument goes to the new one
+    // (an instrument is only ever out with a live node, so there's one to retire)
+    if (TYPE_POOL_FREE_COUNT[type] == 0)
+    {
+        int oldest = oldestNodeOfType(type);
+#if MIDI_EXPORT
+        midiReleaseNode(oldest);
+#endif
+        freeNode(oldest);
+    }
+    
+    // if node count is max - 1 (i.e. room for only 1 more node), trigger an older node to fade out and die
+    // (this means the real max is actually max - 1)
+    if (!(LIVE_NODE_COUNT < NODE_CAP - 1)) ageEarliestNode();
+    
+    // if we have too many nodes, return early
+    if (LIVE_NODE_COUNT > NODE_CAP - 1) return;
+    
+    int nodeID = -1;
+    if (LAST_FREED_NODE == -1)
+    {
+        while (nodeID == -1)
+        {
+            for (int i = 0; i < MAX_NODES; i++)
+            {
+                if (NODE_TYPE[i] == Dead) nodeID = i;
+            }
+        }
+    }
+    else
+    {
+        nodeID = LAST_FREED_NODE;
+        LAST_FREED_NODE = -1;
+    }
+    
+    // node state
+    NODE_LIFESPAN[nodeID] = (float)NODE_LIFETIME * LIFETIME_SCALE;
+    NODE_DEATH_TIME[nodeID] = CURRENT_TIME + NODE_LIFESPAN[nodeID];
+    initNode(nodeID, type, X, Y);
+    
+    // always touch and pulse right away
+    touchNode(nodeID);
+    pulseNode(nodeID);
+    scheduleTimer(nodeID * NodeTimerCount + TouchTimer, nextTouchSlot(nodeID));
+    scheduleTimer(nodeID * NodeTimerCount + DeathTimer, NODE_DEATH_TIME[nodeID]);
+    
+    // node management
+    LIVE_NODE_COUNT++;
+}
+
+
+static void rotatePitchField(void)
+{
+    PITCH_FIELD_ID = (PITCH_FIELD_ID + 1) % 4;
+    PITCH_FIELD = PITCH_FIELD_SET[PITCH_FIELD_ID];
+    scheduleTimer(PITCH_FIELD_TIMER, CURRENT_TIME + CHANGE_PITCH_FIELD_RATE);
+}
+
+static void fireTimer(int timerID)
+{
+    TIMERS_FIRED++;
+#if SOAK_TEST
+    // the wheel against the clock: nothing fires before it's due or a step or more after
+    if (TIMER_DUE[timerID] > CURRENT_TIME || CURRENT_TIME - TIMER_DUE[timerID] >= (uint64_t)SOAK_STEP) SOAK_MISTIMED++;
+#endif
+    if (timerID == PITCH_FIELD_TIMER)
+    {
+        rotatePitchField();
+        return;
+    }
+    
+    int nodeID = timerID / NodeTimerCount;
+    switch (timerID % NodeTimerCount)
+    {
+        case TouchTimer:
+            // touches due together are batched after the wheel is advanced
+            TOUCH_QUEUE[TOUCH_QUEUE_COUNT++] = nodeID;
+            scheduleTimer(timerID, nextTouchSlot(nodeID));
+            break;
+        case PulseTimer:
+            pulseNode(nodeID);
+            break;
+        case DeathTimer:
+            freeNode(nodeID);
+            break;
+    }
+}
+
+// pop & fire everything due up to the current time
+static void advanceTimers(void)
+{
+    TIMERS_FIRED = 0;
+    uint64_t nowTick = CURRENT_TIME >> WHEEL_SLOT_SHIFT;
+    
+    // slots wholly in the past fire everything in them
+    while (WHEEL_TICK < nowTick)
+    {
+        int slot = WHEEL_TICK & WHEEL_MASK;
+        while (WHEEL_HEAD[slot] != -1)
+        {
+            int timerID = WHEEL_HEAD[slot];
+            cancelTimer(timerID);
+            fireTimer(timerID);
+        }
+        
+        WHEEL_TICK++;
+        
+        // level 0 turned over, bring the next level 1 slot down
+        if ((WHEEL_TICK & WHEEL_MASK) == 0)
+        {
+            int upper = WHEEL_SLOTS + ((WHEEL_TICK >> WHEEL_BITS) & WHEEL_MASK);
+            while (WHEEL_HEAD[upper] != -1)
+            {
+                int timerID = WHEEL_HEAD[upper];
+                cancelTimer(timerID);
+                placeTimer(timerID);
+            }
+        }
+    }
+    
+    // the current slot only fires what is actually due
+    int slot = WHEEL_TICK & WHEEL_MASK;
+    int timerID = WHEEL_HEAD[slot];
+    while (timerID != -1)
+    {
+        if (TIMER_DUE[timerID] <= CURRENT_TIME)
+        {
+            cancelTimer(timerID);
+            fireTimer(timerID);
+            // firing can relink anything in this slot, start over
+            timerID = WHEEL_HEAD[slot];
+        }
+        else timerID = TIMER_NEXT[timerID];
+    }
+}
+
+#if !PARAM_SWEEP
+// estimate audio load from live voice costs & adjust node cap and lifetime to stay in budget
+static void governAudioLoad(void)
+{
+    float cost = 0.0f;
+    int voices = 0;
+    int fadingCount = 0;
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        if (NODE_TYPE[i] == Dead) continue;
+        // overlapping notes multiply a node's cost
+        int active = PD->sound->instrument->activeVoiceCount(NODE_INSTRUMENT[i]);
+        voices += active;
+        cost += NODE_COST[i] * (float)(active > 1 ? active : 1);
+        if (NODE_DEATH_TIME[i] <= CURRENT_TIME + NODE_FADE_BUFFER) fadingCount++;
+    }
+    AUDIO_LOAD = cost / AUDIO_BUDGET;
+    ACTIVE_VOICES = voices;
+    if (voices > PEAK_ACTIVE_VOICES) PEAK_ACTIVE_VOICES = voices;
+    
+    if (AUDIO_LOAD > GOVERNOR_HIGH_LOAD)
+    {
+        if (NODE_CAP > MIN_NODE_CAP) NODE_CAP--;
+        LIFETIME_SCALE *= 0.8f;
+        if (LIFETIME_SCALE < MIN_LIFETIME_SCALE) LIFETIME_SCALE = MIN_LIFETIME_SCALE;
+    }
+    else if (AUDIO_LOAD < GOVERNOR_LOW_LOAD)
+    {
+        if (NODE_CAP < MAX_NODES) NODE_CAP++;
+        LIFETIME_SCALE *= 1.25f;
+        if (LIFETIME_SCALE > 1.0f) LIFETIME_SCALE = 1.0f;
+    }
+    
+    // over the cap, start fading the oldest node out (unless enough are already on their way out)
+    if (LIVE_NODE_COUNT - fadingCount > NODE_CAP) ageEarliestNode();
+}
+#endif
+
+static void setup(PlaydateAPI* pd)
+{
+    PD = (PlaydateAPI *)pd;
+    LAST_REAL_TIME = PD->sound->getCurrentTime();
+    CURRENT_TIME = LAST_REAL_TIME;
+    CURRENT_TIME_REMAINDER = 0.0f;
+#if SOAK_TEST
+    CURRENT_TIME = SOAK_START_TIME;
+#endif
+    TOUCH_EPOCH = CURRENT_TIME;
+    
+    BASE_PULSE = 0.5f;
+    TIME_VELOCITY = 1.0f;
+    MAX_DISTANCE_FROM_CENTER = distance(0, 0, CENTER_X, CENTER_Y);
+    INVERSE_MAX_DIST_FROM_CENTER = 1.0f / MAX_DISTANCE_FROM_CENTER;
+    buildSpatialMap(&DEFAULT_SPATIAL_MAP, CENTER_X, CENTER_Y);
+    buildRippleSpans();
+#if MULTIRATE_VOICES
+    buildSineTable();
+#endif
+#if SAMPLE_VOICES
+    buildVoiceSamples();
+    static const char *engineOptions[] = { "synth", "samples" };
+    ENGINE_MENU = PD->system->addOptionsMenuItem("engine", engineOptions, 2, engineMenuChanged, NULL);
+#endif
+#if MIDI_EXPORT
+    MIDI_MENU = PD->system->addCheckmarkMenuItem("midi", 0, midiMenuChanged, NULL);
+#endif
+#if WAV_CAPTURE
+    WAV_MENU = PD->system->addCheckmarkMenuItem("record", 0, wavMenuChanged, NULL);
+#endif
+#if WATER_FIELD
+    buildWaterDither();
+#if WATER_BENCH
+    benchWater();
+#endif
+#endif
+    SPATIAL_MAP = &DEFAULT_SPATIAL_MAP;
+    INVERSE_FADE_BUFFER = 1.0f / (float)NODE_FADE_BUFFER;
+    LAST_FREED_NODE = -1;
+    NODE_CAP = MAX_NODES;
+    LIFETIME_SCALE = 1.0f;
+    AUDIO_LOAD = 0.0f;
+    NEXT_GOVERN = CURRENT_TIME + GOVERN_RATE;
+    
+    int i;
+    for (i = 0; i < MAX_NODES; i++)
+    {
+        // Default all nodes to dead
+        NODE_TYPE[i] = Dead;
+        
+        // Default all fade vol to unset
+        NODE_FADE_VOL[i].l = -1.0f;
+        NODE_COST[i] = 0.0f;
+    }
+    
+    resetTimerWheel();
+    
+    for (i = 0; i < GRID_HEIGHT; i++)
+    {
+        for (int j = 0; j < GRID_WIDTH; j++)
+        {
+            GRID_POINT_NODE_COUNT[i][j] = 0;
+        }
+        
+    }
+    
+    // load images
+    PLAYER_BM = PD->graphics->loadBitmap("images/player", &ERR);
+    for (int t = Strong; t < NodeTypeCount; t++)
+    {
+        for (int frame = 0; frame < 8; frame++)
+        {
+            char *path = NULL;
+            PD->system->formatString(&path, NODE_TYPE_INFO[t].imageFormat, frame + 1);
+            NODE_BMT[t][frame] = PD->graphics->loadBitmap(path, &ERR);
+            PD->system->realloc(path, 0);
+            for (int size = 0; size < NODE_SIZES; size++)
+            {
+                float scale = lerp(NODE_MIN_SCALE, NODE_MAX_SCALE, (float)size / (float)(NODE_SIZES - 1));
+                int bytes;
+                NODE_SIZED_BMT[t][frame][size] = PD->graphics->rotatedBitmap(NODE_BMT[t][frame], 0.0f, scale, scale, &bytes);
+            }
+        }
+    }
+    
+    // make sprites
+    const struct playdate_sprite *sprite = PD->sprite;
+    PLAYER_SPRITE = sprite->newSprite();
+    sprite->setImage(PLAYER_SPRITE, PLAYER_BM, kBitmapUnflipped);
+    for (int t = Strong; t < NodeTypeCount; t++)
+    {
+        NODE_SPRITE_MASTER[t] = sprite->newSprite();
+        sprite->setImage(NODE_SPRITE_MASTER[t], NODE_BMT[t][0], kBitmapUnflipped);
+    }
+    
+    sprite->addSprite(PLAYER_SPRITE);
+#if WATER_FIELD
+    addWaterSprite();
+#endif
+    PLAYER_X = CENTER_X;
+    PLAYER_Y = CENTER_Y;
+    sprite->moveTo(PLAYER_SPRITE, PLAYER_X, PLAYER_Y);
+    
+    // add global effects
+    const struct playdate_sound *pdSound = PD->sound;
+#if AUDIO_RING_TEST
+    testAudioRing();
+#endif
+    CHANNEL = pdSound->channel->newChannel();
+    AUDIO_CONTROL = pdSound->channel->addCallbackSource(CHANNEL, audioControlSource, NULL, 0);
     
-    // node state
-    NODE_TYPE[nodeID] = type;
-    NODE_DEATH_TIME[nodeID] = CURRENT_TIME + NODE_LIFETIME;
-    NODE_NEED_TOUCH[nodeID] = 1;
-    int gridX = gridScaleInt(X);
-    int gridY = gridScaleInt(Y);
-    NODE_GRID_X[nodeID] = gridX;
-    NODE_GRID_Y[nodeID] = gridY;
-    GRID_POINT_NODE_COUNT[gridY][gridX] += 1;
+    HIGH_SHELF = pdSound->effect->twopolefilter->newFilter();
+    PD->sound->effect->twopolefilter->setType(HIGH_SHELF, kFilterTypeHighShelf);
+    PD->sound->effect->twopolefilter->setFrequency(HIGH_SHELF, 800.0f);
+    PD->sound->effect->twopolefilter->setResonance(HIGH_SHELF, 1.0f);
+    PD->sound->effect->twopolefilter->setGain(HIGH_SHELF, lerp(-1.0f * MIN_HIGHS, MAX_HIGHS, 0.5f));
+    pdSound->channel->addEffect(CHANNEL, (SoundEffect *)HIGH_SHELF);
+    
+    LOW_SHELF = pdSound->effect->twopolefilter->newFilter();
+    PD->sound->effect->twopolefilter->setType(LOW_SHELF, kFilterTypeLowShelf);
+    PD->sound->effect->twopolefilter->setFrequency(LOW_SHELF, 300.0f);
+    PD->sound->effect->twopolefilter->setResonance(LOW_SHELF, 1.0f);
+    PD->sound->effect->twopolefilter->setGain(LOW_SHELF, lerp(-1.0f * MIN_LOWS, MAX_LOWS, 0.5f));
+    pdSound->channel->addEffect(CHANNEL, (SoundEffect *)LOW_SHELF);
+    
+    AUDIO_METER = pdSound->effect->newEffect(audioMeterEffect, NULL);
+    pdSound->channel->addEffect(CHANNEL, AUDIO_METER);
+#if WAV_CAPTURE
+    // last, so it hears everything
+    WAV_TAP = pdSound->effect->newEffect(wavTapEffect, NULL);
+    pdSound->channel->addEffect(CHANNEL, WAV_TAP);
+#endif
+    
+    buildNodeVoices();
+    
+    /*
+    DELAY = pdSound->effect->delayline->newDelayLine(SAMPLE_RATE, 1);
+    pdSound->effect->delayline->setFeedback(DELAY, 0.9f);
+    pdSound->effect->delayline->setLength(DELAY, 35);
+    DELAY_OUT = pdSound->effect->delayline->addTap(DELAY, 0);
+    pdSound->source->setVolume((SoundSource *)DELAY_OUT, 1.0f, 1.0f);
+    pdSound->channel->addSource(CHANNEL, (SoundSource *)DELAY_OUT);
+     */
+    
+    PITCH_FIELD_ID = TAKE_PITCH_FIELD;
+    PITCH_FIELD = PITCH_FIELD_SET[PITCH_FIELD_ID];
+    scheduleTimer(PITCH_FIELD_TIMER, CURRENT_TIME + CHANGE_PITCH_FIELD_RATE);
+    
+#if BATCH_BENCH
+    benchNodeParams();
+#endif
+    
+    // after the benches, so they don't shift the take
+    seedTake(TAKE_SEED);
+    PD->system->logToConsole("take: seed %d, pitch field %d", TAKE_SEED, TAKE_PITCH_FIELD);
+    
+#if REWIND
+    PD->system->logToConsole("rewind: %d KB budget (%d KB snapshots + %d KB index)",
+                             (int)((sizeof(REWIND_DATA) + sizeof(REWIND_OFFSET) + sizeof(REWIND_SHADOW)) / 1024),
+                             (int)(sizeof(REWIND_DATA) / 1024),
+                             (int)((sizeof(REWIND_OFFSET) + sizeof(REWIND_SHADOW)) / 1024));
+#endif
+    
+#if PARAM_SWEEP
+    // note events only, nothing is synthesized
+    pdSound->removeChannel(CHANNEL);
+#endif
+}
+
+#if SESSION_RESUME
+static void saveSession(void);
+static void resumeSession(void);
+#endif
+#if API_TRACE
+static PlaydateAPI *installApiTrace(PlaydateAPI *pd);
+static void clearApiTraceFrame(void);
+#endif
+
+#ifdef _WINDLL
+__declspec(dllexport)
+#endif
+int eventHandler(PlaydateAPI* pd, PDSystemEvent event, uint32_t arg)
+{
+    (void)arg; // arg is currently only used for event = kEventKeyPressed
+
+    if ( event == kEventInit )
+    {
+#if API_TRACE
+        pd = installApiTrace(pd);
+#endif
+        setup(pd);
+#if SESSION_RESUME
+        resumeSession();
+#endif
+#if API_TRACE
+        // startup isn't a frame
+        clearApiTraceFrame();
+#endif
+        
+        // get outta here, lua
+        pd->system->setUpdateCallback(update, pd);
+    }
+#if SESSION_RESUME
+    else if (event == kEventLock) saveSession();
+#endif
+    else if (event == kEventTerminate)
+    {
+#if SESSION_RESUME
+        saveSession();
+#endif
+#if MIDI_EXPORT
+        stopMidiExport();
+#endif
+#if WAV_CAPTURE
+        stopWavCaptureNow();
+#endif
+    }
+    
+    return 0;
+}
+
+static void rotatePlayer(float angle)
+{
+    int rotation = (int)(angle * (float)PLAYER_ROTATIONS / 360.0f + 0.5f) % PLAYER_ROTATIONS;
+    if (rotation == PLAYER_ROTATION) return;
+    PLAYER_ROTATION = rotation;
+    
+    if (ROTATED_PLAYER_BM[rotation] == NULL)
+    {
+        // time the build without losing whatever else is timing this frame
+        float before = PD->system->getElapsedTime();
+        int size = 0;
+        ROTATED_PLAYER_BM[rotation] = PD->graphics->rotatedBitmap(
+                                                                 PLAYER_BM,
+                                                                 (float)rotation * 360.0f / (float)PLAYER_ROTATIONS,
+                                                                 1.0f,
+                                                                 1.0f,
+                                                                 &size
+                                                                 );
+        ROTATED_PLAYER_SECONDS += PD->system->getElapsedTime() - before;
+        ROTATED_PLAYER_BYTES += size;
+        ROTATED_PLAYER_COUNT++;
+        // running totals, the crank may never cover every angle
+        PD->system->logToConsole("player rotation cache: %d/%d frames, %d bytes, %.1f ms to build",
+                                 ROTATED_PLAYER_COUNT, PLAYER_ROTATIONS, ROTATED_PLAYER_BYTES, (double)(ROTATED_PLAYER_SECONDS * 1000.0f));
+    }
+    PD->sprite->setImage(PLAYER_SPRITE, ROTATED_PLAYER_BM[rotation], kBitmapUnflipped);
+}
+
+#if REWIND || SESSION_RESUME
+// what a snapshot holds, the rest comes back from a touch
+static void captureState(struct SnapshotState *state)
+{
+    state->time = CURRENT_TIME;
+    state->pitchFieldDue = TIMER_DUE[PITCH_FIELD_TIMER];
+    state->rng = TAKE_RNG;
+    state->lifetimeScale = LIFETIME_SCALE;
+    state->pitchFieldID = (uint8_t)PITCH_FIELD_ID;
+    state->nodeCap = (uint8_t)NODE_CAP;
+    state->liveMask = 0;
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        struct SnapshotNode *node = &state->node[i];
+        if (NODE_TYPE[i] == Dead) { node->type = Dead; continue; }
+        state->liveMask |= 1 << i;
+        node->type = (uint8_t)NODE_TYPE[i];
+        node->pitchSet = (uint8_t)NODE_PITCH_SET[i];
+        node->gridX = (uint8_t)NODE_GRID_X[i];
+        node->gridY = (uint8_t)NODE_GRID_Y[i];
+        node->x = (int16_t)NODE_X[i];
+        node->y = (int16_t)NODE_Y[i];
+        node->lifespan = NODE_LIFESPAN[i];
+        node->deathTime = NODE_DEATH_TIME[i];
+        node->nextPulse = NODE_NEXT_PULSE[i];
+    }
+}
+
+// put the world back to a snapshot: nodes freed, recreated or updated in place, timers & sound parameters rebuilt
+// (without the touch jitter, so positions & the random stream come back exactly)
+static void restoreState(const struct SnapshotState *state)
+{
+    CURRENT_TIME = state->time;
+    CURRENT_TIME_REMAINDER = 0.0f;
+    if (TOUCH_EPOCH > CURRENT_TIME) TOUCH_EPOCH = CURRENT_TIME;
+    resetTimerWheel();
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        if (NODE_TYPE[i] != Dead && NODE_TYPE[i] != state->node[i].type) freeNode(i);
+    }
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        const struct SnapshotNode *node = &state->node[i];
+        if (node->type == Dead) continue;
+        if (NODE_TYPE[i] == Dead)
+        {
+            initNode(i, (enum NodeType)node->type, node->x, node->y);
+            LIVE_NODE_COUNT++;
+        }
+        GRID_POINT_NODE_COUNT[NODE_GRID_Y[i]][NODE_GRID_X[i]] -= 1;
+        NODE_GRID_X[i] = node->gridX;
+        NODE_GRID_Y[i] = node->gridY;
+        GRID_POINT_NODE_COUNT[NODE_GRID_Y[i]][NODE_GRID_X[i]] += 1;
+        NODE_PITCH_SET[i] = node->pitchSet;
+        NODE_LIFESPAN[i] = node->lifespan;
+        NODE_DEATH_TIME[i] = node->deathTime;
+        NODE_NEXT_PULSE[i] = node->nextPulse;
+        NODE_X[i] = node->x;
+        NODE_Y[i] = node->y;
+        PD->sprite->moveTo(NODE_SPRITE[i], NODE_X[i], NODE_Y[i]);
+    }
+    // parameters once all nodes are back, as closeness depends on the rest
+    int live[MAX_NODES];
+    int liveCount = 0;
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        if (state->node[i].type == Dead) continue;
+        live[liveCount++] = i;
+        scheduleTimer(i * NodeTimerCount + TouchTimer, nextTouchSlot(i));
+        scheduleTimer(i * NodeTimerCount + PulseTimer, NODE_NEXT_PULSE[i]);
+        scheduleTimer(i * NodeTimerCount + DeathTimer, NODE_DEATH_TIME[i]);
+    }
+    LAST_FREED_NODE = -1;
+    
+    PITCH_FIELD_ID = state->pitchFieldID;
+    PITCH_FIELD = PITCH_FIELD_SET[PITCH_FIELD_ID];
+    scheduleTimer(PITCH_FIELD_TIMER, state->pitchFieldDue);
+    NODE_CAP = state->nodeCap;
+    LIFETIME_SCALE = state->lifetimeScale;
+    NEXT_GOVERN = CURRENT_TIME + GOVERN_RATE;
+    setNodeParams(live, liveCount);
+    TAKE_RNG = state->rng;
+}
+#endif
+
+#if REWIND
+static int snapshotNodeChanged(const struct SnapshotNode *a, const struct SnapshotNode *b)
+{
+    return a->type != b->type || a->pitchSet != b->pitchSet || a->gridX != b->gridX || a->gridY != b->gridY ||
+           a->x != b->x || a->y != b->y || a->lifespan != b->lifespan ||
+           a->deathTime != b->deathTime || a->nextPulse != b->nextPulse;
+}
+
+static struct RewindHeader rewindHeader(int entry)
+{
+    struct RewindHeader header;
+    memcpy(&header, REWIND_DATA + REWIND_OFFSET[entry], sizeof(header));
+    return header;
+}
+
+static int rewindEntrySize(struct RewindHeader header)
+{
+    return (int)(sizeof(header) + __builtin_popcount(header.changedMask) * sizeof(struct RewindRecord));
+}
+
+// drop the oldest keyframe & its deltas
+static void evictRewindGroup(void)
+{
+    do
+    {
+        REWIND_FIRST = (REWIND_FIRST + 1) % REWIND_ENTRIES;
+        REWIND_COUNT--;
+    } while (REWIND_COUNT > 0 && !rewindHeader(REWIND_FIRST).key);
+}
+
+// find room for size bytes in the data ring, evicting from the old end
+static void reserveRewindSpace(int size)
+{
+    if (REWIND_COUNT == REWIND_ENTRIES) evictRewindGroup();
+    for (;;)
+    {
+        if (REWIND_COUNT == 0)
+        {
+            if (REWIND_WRITE + size > REWIND_BUDGET) REWIND_WRITE = 0;
+            return;
+        }
+        int oldest = REWIND_OFFSET[REWIND_FIRST];
+        if (oldest >= REWIND_WRITE)
+        {
+            if (oldest >= REWIND_WRITE + size) return;
+            evictRewindGroup();
+        }
+        else if (REWIND_WRITE + size <= REWIND_BUDGET) return;
+        else REWIND_WRITE = 0;
+    }
+}
+
+// once per control tick: a keyframe every REWIND_KEYFRAME_TICKS, otherwise only the nodes that changed
+static void recordRewind(void)
+{
+    struct SnapshotState state;
+    captureState(&state);
+    
+    struct RewindHeader header;
+    header.time = state.time;
+    header.pitchFieldDue = state.pitchFieldDue;
+    header.rng = state.rng;
+    header.lifetimeScale = state.lifetimeScale;
+    header.liveMask = state.liveMask;
+    header.pitchFieldID = state.pitchFieldID;
+    header.nodeCap = state.nodeCap;
+    header.key = REWIND_COUNT == 0 || REWIND_SINCE_KEY >= REWIND_KEYFRAME_TICKS;
+    header.changedMask = 0;
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        if (!(state.liveMask & (1 << i))) continue;
+        if (header.key || !(REWIND_SHADOW.liveMask & (1 << i)) || snapshotNodeChanged(&state.node[i], &REWIND_SHADOW.node[i]))
+        {
+            header.changedMask |= 1 << i;
+        }
+    }
+    
+    int size = rewindEntrySize(header);
+    reserveRewindSpace(size);
+    // eviction may have emptied the ring, which has to start on a keyframe
+    if (REWIND_COUNT == 0 && !header.key)
+    {
+        header.key = 1;
+        header.changedMask = state.liveMask;
+        size = rewindEntrySize(header);
+        reserveRewindSpace(size);
+    }
+    
+    uint8_t *out = REWIND_DATA + REWIND_WRITE;
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        if (!(header.changedMask & (1 << i))) continue;
+        const struct SnapshotNode *node = &state.node[i];
+        struct RewindRecord record;
+        record.type = node->type;
+        record.pitchSet = node->pitchSet;
+        record.gridX = node->gridX;
+        record.gridY = node->gridY;
+        record.x = node->x;
+        record.y = node->y;
+        record.lifespan = node->lifespan;
+        record.deathTime = (int32_t)(node->deathTime - state.time);
+        record.nextPulse = (int32_t)(node->nextPulse - state.time);
+        memcpy(out, &record, sizeof(record));
+        out += sizeof(record);
+    }
+    
+    int entry = (REWIND_FIRST + REWIND_COUNT) % REWIND_ENTRIES;
+    REWIND_OFFSET[entry] = (uint16_t)REWIND_WRITE;
+    REWIND_WRITE += size;
+    REWIND_COUNT++;
+    REWIND_SINCE_KEY = header.key ? 1 : REWIND_SINCE_KEY + 1;
+    REWIND_SHADOW = state;
+}
+
+// replay one entry over state
+static void decodeRewindEntry(int entry, struct SnapshotState *state)
+{
+    const uint8_t *in = REWIND_DATA + REWIND_OFFSET[entry];
+    struct RewindHeader header;
+    memcpy(&header, in, sizeof(header));
+    in += sizeof(header);
+    
+    state->time = header.time;
+    state->pitchFieldDue = header.pitchFieldDue;
+    state->lifetimeScale = header.lifetimeScale;
+    state->pitchFieldID = header.pitchFieldID;
+    state->nodeCap = header.nodeCap;
+    state->liveMask = header.liveMask;
+    state->rng = header.rng;
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        if (!(header.liveMask & (1 << i))) { state->node[i].type = Dead; continue; }
+        if (!(header.changedMask & (1 << i))) continue;
+        struct RewindRecord record;
+        memcpy(&record, in, sizeof(record));
+        in += sizeof(record);
+        struct SnapshotNode *node = &state->node[i];
+        node->type = record.type;
+        node->pitchSet = record.pitchSet;
+        node->gridX = record.gridX;
+        node->gridY = record.gridY;
+        node->x = record.x;
+        node->y = record.y;
+        node->lifespan = record.lifespan;
+        node->deathTime = header.time + record.deathTime;
+        node->nextPulse = header.time + record.nextPulse;
+    }
+}
+
+// put the world back to how it was at entry (counted from the oldest)
+static void restoreRewind(int position)
+{
+    float before = PD->system->getElapsedTime();
+    
+    int last = (REWIND_FIRST + position) % REWIND_ENTRIES;
+    int entry = last;
+    while (entry != REWIND_FIRST && !rewindHeader(entry).key) entry = (entry + REWIND_ENTRIES - 1) % REWIND_ENTRIES;
+    struct SnapshotState state;
+    for (;;)
+    {
+        decodeRewindEntry(entry, &state);
+        if (entry == last) break;
+        entry = (entry + 1) % REWIND_ENTRIES;
+    }
+    
+    restoreState(&state);
+    REWIND_SHADOW = state;
+    float restore = PD->system->getElapsedTime() - before;
+    if (restore > REWIND_WORST_RESTORE) REWIND_WORST_RESTORE = restore;
+}
+
+// crank back past the slowest speed to scrub back, forward to scrub back up to now,
+// let go to carry on from wherever it was left
+static void scrubRewind(float change)
+{
+    if (!REWINDING)
+    {
+        if (REWIND_COUNT < 2) return;
+        REWINDING = 1;
+        REWIND_POSITION = REWIND_COUNT - 1;
+        REWIND_CRANK = 0.0f;
+        REWIND_IDLE_FRAMES = 0;
+        REWIND_WORST_RESTORE = 0.0f;
+        int used = REWIND_WRITE - REWIND_OFFSET[REWIND_FIRST];
+        if (used <= 0) used += REWIND_BUDGET;
+        PD->system->logToConsole("rewind: %.1f s of history in %d ticks, %d of %d bytes",
+                                 (double)((float)(CURRENT_TIME - rewindHeader(REWIND_FIRST).time) / (float)SAMPLE_RATE),
+                                 REWIND_COUNT, used, REWIND_BUDGET);
+    }
+    
+    if (change == 0.0f)
+    {
+        if (++REWIND_IDLE_FRAMES < REWIND_RESUME_FRAMES) return;
+        // carry on from here, the future we scrubbed back from is gone
+        REWIND_COUNT = REWIND_POSITION + 1;
+        int last = (REWIND_FIRST + REWIND_POSITION) % REWIND_ENTRIES;
+        REWIND_WRITE = REWIND_OFFSET[last] + rewindEntrySize(rewindHeader(last));
+        // & the keyframe group runs on from the resumed entry, not the discarded head
+        REWIND_SINCE_KEY = 1;
+        for (int entry = last; entry != REWIND_FIRST && !rewindHeader(entry).key; entry = (entry + REWIND_ENTRIES - 1) % REWIND_ENTRIES)
+        {
+            REWIND_SINCE_KEY++;
+        }
+        REWINDING = 0;
+        PD->system->logToConsole("rewind: resumed, worst restore %.2f ms", (double)(REWIND_WORST_RESTORE * 1000.0f));
+        return;
+    }
+    REWIND_IDLE_FRAMES = 0;
+    
+    REWIND_CRANK += change;
+    int ticks = (int)(REWIND_CRANK / REWIND_DEGREES_PER_TICK);
+    REWIND_CRANK -= (float)ticks * REWIND_DEGREES_PER_TICK;
+    int position = REWIND_POSITION + ticks;
+    if (position < 0) position = 0;
+    if (position > REWIND_COUNT - 1) position = REWIND_COUNT - 1;
+    if (position == REWIND_POSITION) return;
+    REWIND_POSITION = position;
+    restoreRewind(position);
+}
+#endif
+
+static void crankTimeVelocity(float change)
+{
+    if (change != 0.0f && TIME_VELOCITY < MAX_TIME_VELOCITY + 1 && TIME_VELOCITY > MIN_TIME_VELOCITY - 1)
+    {
+        // adjust time velocity
+        TIME_VELOCITY += change / 720.0f;
+        if (TIME_VELOCITY > MAX_TIME_VELOCITY) TIME_VELOCITY = MAX_TIME_VELOCITY;
+        if (TIME_VELOCITY < MIN_TIME_VELOCITY) TIME_VELOCITY = MIN_TIME_VELOCITY;
+        
+        // TODO adjust filters
+        float filterAlpha = TIME_VELOCITY/MAX_TIME_VELOCITY;
+        PD->sound->effect->twopolefilter->setGain(
+                                                  HIGH_SHELF,
+                                                  lerp(-1.0f * MIN_HIGHS, MAX_HIGHS, filterAlpha)
+                                                  );
+        PD->sound->effect->twopolefilter->setGain(
+                                                  LOW_SHELF,
+                                                  lerp(-1.0f * MIN_LOWS, MAX_LOWS, 1.0f - filterAlpha)
+                                                  );
+        
+        // TODO adjust visuals
+    }
+}
+
+#if SESSION_RESUME
+static void putSessionField(uint8_t **out, uint64_t v, int bytes)
+{
+    for (int b = 0; b < bytes; b++) *(*out)++ = (uint8_t)(v >> (8 * b));
+}
+
+static uint64_t getSessionField(const uint8_t **in, int bytes)
+{
+    uint64_t v = 0;
+    for (int b = 0; b < bytes; b++) v |= (uint64_t)*(*in)++ << (8 * b);
+    return v;
+}
+
+static uint32_t floatBits(float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    return v;
+}
+
+static float bitsFloat(uint32_t v)
+{
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+// SESSION_BYTES into out
+static void encodeSession(const struct SessionFile *session, uint8_t *out)
+{
+    putSessionField(&out, session->magic, 4);
+    putSessionField(&out, session->version, 4);
+    putSessionField(&out, session->size, 4);
+    putSessionField(&out, floatBits(session->timeVelocity), 4);
+    putSessionField(&out, floatBits(session->playerX), 4);
+    putSessionField(&out, floatBits(session->playerY), 4);
+    
+    const struct SnapshotState *state = &session->state;
+    putSessionField(&out, state->time, 8);
+    putSessionField(&out, state->pitchFieldDue, 8);
+    putSessionField(&out, state->rng, 4);
+    putSessionField(&out, floatBits(state->lifetimeScale), 4);
+    putSessionField(&out, state->liveMask, 2);
+    putSessionField(&out, state->pitchFieldID, 1);
+    putSessionField(&out, state->nodeCap, 1);
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        const struct SnapshotNode *node = &state->node[i];
+        putSessionField(&out, node->type, 1);
+        putSessionField(&out, node->pitchSet, 1);
+        putSessionField(&out, node->gridX, 1);
+        putSessionField(&out, node->gridY, 1);
+        putSessionField(&out, (uint16_t)node->x, 2);
+        putSessionField(&out, (uint16_t)node->y, 2);
+        putSessionField(&out, (uint32_t)node->lifespan, 4);
+        putSessionField(&out, node->deathTime, 8);
+        putSessionField(&out, node->nextPulse, 8);
+    }
+}
+
+// SESSION_BYTES out of in
+static void decodeSession(const uint8_t *in, struct SessionFile *session)
+{
+    session->magic = (uint32_t)getSessionField(&in, 4);
+    session->version = (uint32_t)getSessionField(&in, 4);
+    session->size = (uint32_t)getSessionField(&in, 4);
+    session->timeVelocity = bitsFloat((uint32_t)getSessionField(&in, 4));
+    session->playerX = bitsFloat((uint32_t)getSessionField(&in, 4));
+    session->playerY = bitsFloat((uint32_t)getSessionField(&in, 4));
+    
+    struct SnapshotState *state = &session->state;
+    state->time = getSessionField(&in, 8);
+    state->pitchFieldDue = getSessionField(&in, 8);
+    state->rng = (uint32_t)getSessionField(&in, 4);
+    state->lifetimeScale = bitsFloat((uint32_t)getSessionField(&in, 4));
+    state->liveMask = (uint16_t)getSessionField(&in, 2);
+    state->pitchFieldID = (uint8_t)getSessionField(&in, 1);
+    state->nodeCap = (uint8_t)getSessionField(&in, 1);
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        struct SnapshotNode *node = &state->node[i];
+        node->type = (uint8_t)getSessionField(&in, 1);
+        node->pitchSet = (uint8_t)getSessionField(&in, 1);
+        node->gridX = (uint8_t)getSessionField(&in, 1);
+        node->gridY = (uint8_t)getSessionField(&in, 1);
+        node->x = (int16_t)(uint16_t)getSessionField(&in, 2);
+        node->y = (int16_t)(uint16_t)getSessionField(&in, 2);
+        node->lifespan = (int)(int32_t)(uint32_t)getSessionField(&in, 4);
+        node->deathTime = getSessionField(&in, 8);
+        node->nextPulse = getSessionField(&in, 8);
+    }
+}
+
+// one write, the snapshot carries the PRNG state
+static void saveSession(void)
+{
+    struct SessionFile session;
+    session.magic = SESSION_MAGIC;
+    session.version = SESSION_VERSION;
+    session.size = SESSION_BYTES;
+    session.timeVelocity = TIME_VELOCITY;
+    session.playerX = PLAYER_X;
+    session.playerY = PLAYER_Y;
+    captureState(&session.state);
+    uint8_t bytes[SESSION_BYTES];
+    encodeSession(&session, bytes);
+    
+    SDFile *file = PD->file->open(SESSION_PATH, kFileWrite);
+    if (file == NULL)
+    {
+        ERR = PD->file->geterr();
+        return;
+    }
+    if (PD->file->write(file, bytes, SESSION_BYTES) != SESSION_BYTES) ERR = PD->file->geterr();
+    PD->file->close(file);
+}
+
+// everything restoreState & the rest of resumeSession index with or rely on has to be in range,
+// a corrupt file or one from another build is rejected rather than half restored
+static int validSession(const struct SessionFile *session)
+{
+    if (session->magic != SESSION_MAGIC || session->version != SESSION_VERSION || session->size != SESSION_BYTES) return 0;
+    // written so NaNs fail too
+    if (!(session->timeVelocity >= MIN_TIME_VELOCITY && session->timeVelocity <= MAX_TIME_VELOCITY)) return 0;
+    if (!(session->playerX >= 0.0f && session->playerX <= (float)LCD_COLUMNS)) return 0;
+    if (!(session->playerY >= 0.0f && session->playerY <= (float)LCD_ROWS)) return 0;
+    
+    const struct SnapshotState *state = &session->state;
+    if (!(state->lifetimeScale >= MIN_LIFETIME_SCALE && state->lifetimeScale <= 1.0f)) return 0;
+    if (state->pitchFieldID >= 4 || state->nodeCap < MIN_NODE_CAP || state->nodeCap > MAX_NODES) return 0;
+    if (state->pitchFieldDue < state->time) return 0;
+    if (state->liveMask >> MAX_NODES) return 0;
+    int typeCount[NodeTypeCount] = { 0 };
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        const struct SnapshotNode *node = &state->node[i];
+        int live = (state->liveMask >> i) & 1;
+        if (node->type >= NodeTypeCount || live != (node->type != Dead)) return 0;
+        if (!live) continue;
+        if (++typeCount[node->type] > NODE_TYPE_INFO[node->type].poolSize) return 0;
+        if (node->pitchSet >= 4 || node->gridX >= GRID_WIDTH || node->gridY >= GRID_HEIGHT) return 0;
+        // (initNode derives a grid point from these too)
+        if (node->x < 0 || node->x >= LCD_COLUMNS || node->y < 0 || node->y >= LCD_ROWS) return 0;
+        if (node->lifespan <= 0 || node->lifespan > NODE_LIFETIME) return 0;
+        if (node->deathTime < state->time || node->deathTime - state->time > (uint64_t)NODE_LIFETIME) return 0;
+        if (node->nextPulse < state->time) return 0;
+    }
+    return 1;
+}
+
+// one read, anything from another version or out of range is ignored
+static void resumeSession(void)
+{
+    SDFile *file = PD->file->open(SESSION_PATH, kFileReadData);
+    if (file == NULL) return;
+    
+    float before = PD->system->getElapsedTime();
+    uint8_t bytes[SESSION_BYTES];
+    int read = PD->file->read(file, bytes, SESSION_BYTES);
+    PD->file->close(file);
+    struct SessionFile session;
+    if (read == SESSION_BYTES) decodeSession(bytes, &session);
+    if (read != SESSION_BYTES || !validSession(&session))
+    {
+        PD->system->logToConsole("session: ignoring snapshot that isn't a valid version %d one", SESSION_VERSION);
+        return;
+    }
+    
+    restoreState(&session.state);
+    // through the crank path so the filters follow
+    crankTimeVelocity((session.timeVelocity - TIME_VELOCITY) * 720.0f);
+    PLAYER_X = session.playerX;
+    PLAYER_Y = session.playerY;
+    PD->sprite->moveTo(PLAYER_SPRITE, PLAYER_X, PLAYER_Y);
+    PD->system->logToConsole("session: resumed %d nodes in %.2f ms, carrying on its own take rather than seed %d", LIVE_NODE_COUNT,
+                             (double)((PD->system->getElapsedTime() - before) * 1000.0f), TAKE_SEED);
+}
+#endif
+
+static void processInputs(void)
+{
+    PDButtons current;
+    PDButtons pushed;
+    PD->system->getButtonState(&current, &pushed, NULL);
+    
+    if (current & kButtonUp) PLAYER_Y -= 3.0f;
+    if (current & kButtonDown) PLAYER_Y += 3.0f;
+    if (current & kButtonLeft) PLAYER_X -= 3.0f;
+    if (current & kButtonRight) PLAYER_X += 3.0f;
+    
+    if (PLAYER_X > (float)LCD_COLUMNS) PLAYER_X -= (float)LCD_COLUMNS;
+    if (PLAYER_Y > (float)LCD_ROWS) PLAYER_Y -= (float)LCD_ROWS;
+    if (PLAYER_X < 0.0f) PLAYER_X += (float)LCD_COLUMNS;
+    if (PLAYER_Y < 0.0f) PLAYER_Y += (float)LCD_ROWS;
+    
+    PD->sprite->moveTo(PLAYER_SPRITE, PLAYER_X, PLAYER_Y);
+    
+#if REWIND
+    if (REWINDING) pushed = 0;
+#endif
+    if (pushed & kButtonA) { makeNode(Strong, PLAYER_X, PLAYER_Y); }
+    else if (pushed & kButtonB) { makeNode(Weak, PLAYER_X, PLAYER_Y); }
+    
+    if (PD->system->isCrankDocked() == 0)
+    {
+        float change = PD->system->getCrankChange();
+#if REWIND
+        if (REWINDING || (change < 0.0f && TIME_VELOCITY <= MIN_TIME_VELOCITY)) scrubRewind(change);
+        else
+#endif
+        crankTimeVelocity(change);
+        rotatePlayer(PD->system->getCrankAngle());
+    }
+}
+
+#if AUDIO_STATS
+static void checkAudioDeadlines(uint32_t now)
+{
+    uint32_t audioClock = __atomic_load_n(&AUDIO_CLOCK, __ATOMIC_ACQUIRE);
+    
+    // the two clocks start apart, only changes in the gap matter
+    int32_t lag = (int32_t)(now - audioClock);
+    if (!AUDIO_LAG_BASELINE_SET)
+    {
+        AUDIO_LAG_BASELINE = lag;
+        AUDIO_LAG_BASELINE_SET = 1;
+        NEXT_AUDIO_STATS = now + SAMPLE_RATE;
+    }
+    lag -= AUDIO_LAG_BASELINE;
+    
+    // the audio side running ahead just means a new, tighter baseline
+    if (lag < 0)
+    {
+        AUDIO_LAG_BASELINE += lag;
+        lag = 0;
+    }
+    if (lag > AUDIO_WORST_LAG) AUDIO_WORST_LAG = lag;
     
-    // node sound
-    const struct playdate_sound *pdSound = PD->sound;
-    PDSynth *synth = pdSound->synth->newSynth();
-    NODE_SYNTH[nodeID] = synth;
-    PDSynthLFO *freqMod;
-    PDSynthLFO *ampMod;
-    if (type == Strong)
+    // count each stall once, then measure from where it left us
+    if (lag > AUDIO_BLOCK_SIZE * 2)
     {
-        pdSound->synth->setWaveform(synth, kWaveformSawtooth);
-        ampMod = pdSound->lfo->newLFO(kLFOTypeTriangle);
-        freqMod = pdSound->lfo->newLFO(kLFOTypeTriangle);
-    } else
+        AUDIO_MISSED_BLOCKS += lag / AUDIO_BLOCK_SIZE - 1;
+        AUDIO_LAG_BASELINE += lag;
+    }
+    
+    if ((int32_t)(now - NEXT_AUDIO_STATS) < 0) return;
+    PD->system->logToConsole("audio missed blocks %d worst lag %d samples max queue %u drops %d",
+                             AUDIO_MISSED_BLOCKS, (int)AUDIO_WORST_LAG, (unsigned)AUDIO_MAX_QUEUE_DEPTH, AUDIO_QUEUE_DROPS);
+    PD->system->logToConsole("node voices %d active, peak %d", ACTIVE_VOICES, PEAK_ACTIVE_VOICES);
+#if MULTIRATE_VOICES
+    uint32_t output = __atomic_load_n(&SUBRATE_OUTPUT_SAMPLES, __ATOMIC_RELAXED);
+    uint32_t computed = __atomic_load_n(&SUBRATE_COMPUTED_SAMPLES, __ATOMIC_RELAXED);
+    if (output > 0)
     {
-        pdSound->synth->setWaveform(synth, kWaveformSine);
-        ampMod = pdSound->lfo->newLFO(kLFOTypeSine);
-        freqMod = pdSound->lfo->newLFO(kLFOTypeSine);
+        PD->system->logToConsole("sine voices computed %.0f%% of their output samples",
+                                 (double)(100.0f * (float)computed / (float)output));
     }
-    pdSound->lfo->setCenter(freqMod, 0.5f);
-    pdSound->lfo->setCenter(ampMod, 0.5f);
-    pdSound->synth->setFrequencyModulator(synth, (PDSynthSignalValue *)freqMod);
-    pdSound->synth->setAmplitudeModulator(synth, (PDSynthSignalValue *)ampMod);
-    NODE_NEXT_PULSE[nodeID] = CURRENT_TIME;
-    NODE_PULSE_MOD[nodeID] = lerp(NODE_MIN_PULSE_MOD, NODE_MAX_PULSE_MOD, 0.5f);
-    NODE_PITCH_SET[nodeID] = quadrantOfPoint(X, Y);
-    pdSound->channel->addSource(CHANNEL, (SoundSource *)synth);
+#endif
+    AUDIO_WORST_LAG = 0;
+    AUDIO_MAX_QUEUE_DEPTH = 0;
+    NEXT_AUDIO_STATS = now + SAMPLE_RATE;
+}
+#endif
+
+#if FRAME_STATS
+static void recordFrameTime(float seconds)
+{
+    int bin = (int)(seconds * 1000.0f / FRAME_STATS_BIN_MS);
+    if (bin >= FRAME_STATS_BINS) bin = FRAME_STATS_BINS - 1;
+    FRAME_HIST[bin]++;
+    FRAME_HIST_COUNT++;
+    if (FRAME_HIST_COUNT < FRAME_STATS_WINDOW) return;
     
-    // node sprite
-    const struct playdate_sprite *sprite = PD->sprite;
-    if (type == 1) { NODE_SPRITE[nodeID] = sprite->copy(NODE_1_SPRITE_MASTER); }
-    else if (type == 2) { NODE_SPRITE[nodeID] = sprite->copy(NODE_2_SPRITE_MASTER); }
-    sprite->moveTo(NODE_SPRITE[nodeID], X, Y);
-    sprite->addSprite(NODE_SPRITE[nodeID]);
-    NODE_ANIM_STATE[nodeID] = 0;
+    // walk the histogram for percentiles, report the upper edge of each bin
+    const float percentiles[4] = { 0.5f, 0.9f, 0.99f, 1.0f };
+    float results[4];
+    int seen = 0;
+    int p = 0;
+    for (int i = 0; i < FRAME_STATS_BINS && p < 4; i++)
+    {
+        seen += FRAME_HIST[i];
+        while (p < 4 && seen >= percentiles[p] * FRAME_HIST_COUNT)
+        {
+            results[p] = (float)(i + 1) * FRAME_STATS_BIN_MS;
+            p++;
+        }
+    }
+    PD->system->logToConsole("frame ms p50 %.1f p90 %.1f p99 %.1f max %.1f",
+                             (double)results[0], (double)results[1], (double)results[2], (double)results[3]);
     
-    // always touch right away
-    touchNode(nodeID);
+    for (int i = 0; i < FRAME_STATS_BINS; i++) FRAME_HIST[i] = 0;
+    FRAME_HIST_COUNT = 0;
+}
+#endif
+
+#if API_TRACE
+static inline void __attribute__((always_inline)) countApiCall(enum ApiTraceCall call, float before)
+{
+    API_TRACE_SECONDS_THIS_FRAME[call] += API_TRACE_REAL.system.getElapsedTime() - before;
+    API_TRACE_CALLS_THIS_FRAME[call]++;
+}
+
+// the wrappers, timed with the untraced clock
+#define API_TRACE_WRAP_V(table, name, params, args) \
+static void traced_##table##_##name params \
+{ \
+    float before = API_TRACE_REAL.system.getElapsedTime(); \
+    API_TRACE_REAL.table.name args; \
+    countApiCall(ApiTrace_##table##_##name, before); \
+}
+#define API_TRACE_WRAP_R(table, type, name, params, args) \
+static type traced_##table##_##name params \
+{ \
+    float before = API_TRACE_REAL.system.getElapsedTime(); \
+    type result = API_TRACE_REAL.table.name args; \
+    countApiCall(ApiTrace_##table##_##name, before); \
+    return result; \
+}
+API_TRACE_CALLS(API_TRACE_WRAP_V, API_TRACE_WRAP_R)
+
+// copy the tables & swap in the wrappers, everything handed the returned API is traced
+static PlaydateAPI *installApiTrace(PlaydateAPI *pd)
+{
+    API_TRACE_REAL.system = *pd->system;
+    API_TRACE_REAL.graphics = *pd->graphics;
+    API_TRACE_REAL.sprite = *pd->sprite;
+    API_TRACE_REAL.sound = *pd->sound;
+    API_TRACE_REAL.channel = *pd->sound->channel;
+    API_TRACE_REAL.synth = *pd->sound->synth;
+    API_TRACE_REAL.lfo = *pd->sound->lfo;
+    API_TRACE_REAL.instrument = *pd->sound->instrument;
+    API_TRACE_WRAPPED = API_TRACE_REAL;
     
-    // node management
-    LIVE_NODE_COUNT++;
+#define API_TRACE_SWAP_V(table, name, params, args) API_TRACE_WRAPPED.table.name = traced_##table##_##name;
+#define API_TRACE_SWAP_R(table, type, name, params, args) API_TRACE_WRAPPED.table.name = traced_##table##_##name;
+    API_TRACE_CALLS(API_TRACE_SWAP_V, API_TRACE_SWAP_R)
+    
+    API_TRACE_WRAPPED.sound.channel = &API_TRACE_WRAPPED.channel;
+    API_TRACE_WRAPPED.sound.synth = &API_TRACE_WRAPPED.synth;
+    API_TRACE_WRAPPED.sound.lfo = &API_TRACE_WRAPPED.lfo;
+    API_TRACE_WRAPPED.sound.instrument = &API_TRACE_WRAPPED.instrument;
+    API_TRACE_API = *pd;
+    API_TRACE_API.system = &API_TRACE_WRAPPED.system;
+    API_TRACE_API.graphics = &API_TRACE_WRAPPED.graphics;
+    API_TRACE_API.sprite = &API_TRACE_WRAPPED.sprite;
+    API_TRACE_API.sound = &API_TRACE_WRAPPED.sound;
+    
+    // start the report fresh
+    SDFile *file = pd->file->open(API_TRACE_PATH, kFileWrite);
+    if (file != NULL) pd->file->close(file);
+    
+    return &API_TRACE_API;
 }
 
-static void setup(PlaydateAPI* pd)
+static void clearApiTraceFrame(void)
 {
-    PD = (PlaydateAPI *)pd;
-    CURRENT_TIME = PD->sound->getCurrentTime();
-    NEXT_TOUCH = CURRENT_TIME + TOUCH_RATE;
+    for (int c = 0; c < ApiTraceCount; c++)
+    {
+        API_TRACE_CALLS_THIS_FRAME[c] = 0;
+        API_TRACE_SECONDS_THIS_FRAME[c] = 0.0f;
+    }
+}
+
+// append the window's histograms to API_TRACE_PATH, one line per call that was made at all
+static void writeApiTrace(void)
+{
+    SDFile *file = PD->file->open(API_TRACE_PATH, kFileAppend);
+    if (file == NULL)
+    {
+        PD->system->logToConsole("api trace: couldn't open %s: %s", API_TRACE_PATH, PD->file->geterr());
+        return;
+    }
     
-    BASE_PULSE = 0.5f;
-    TIME_VELOCITY = 1.0f;
-    MAX_DISTANCE_FROM_CENTER = distance(0, 0, CENTER_X, CENTER_Y);
-    INVERSE_MAX_DIST_FROM_CENTER = 1.0f / MAX_DISTANCE_FROM_CENTER;
-    INVERSE_FADE_BUFFER = 1.0f / (float)NODE_FADE_BUFFER;
-    LAST_FREED_NODE = -1;
+    char *line;
+    int length = PD->system->formatString(&line, "%d frames, calls per frame in bins 0 1 2+ 4+ 8+ 16+ 32+ 64+\n", API_TRACE_FRAMES);
+    PD->file->write(file, line, length);
+    API_TRACE_REAL.system.realloc(line, 0);
     
-    int i;
-    for (i = 0; i < MAX_NODES; i++)
+    int calls = 0;
+    float seconds = 0.0f;
+    for (int c = 0; c < ApiTraceCount; c++)
     {
-        // Default all nodes to dead
-        NODE_TYPE[i] = Dead;
+        if (API_TRACE_TOTAL_CALLS[c] == 0) continue;
+        calls += API_TRACE_TOTAL_CALLS[c];
+        seconds += API_TRACE_TOTAL_SECONDS[c];
         
-        // Default all fade vol to unset
-        NODE_FADE_VOL[i].l = -1.0f;
+        const int *hist = API_TRACE_HIST[c];
+        length = PD->system->formatString(&line, "%-34s %8.2f/frame max %5d %8.2f us/call %6.3f ms/frame | %d %d %d %d %d %d %d %d\n",
+                                          API_TRACE_NAMES[c],
+                                          (double)((float)API_TRACE_TOTAL_CALLS[c] / (float)API_TRACE_FRAMES),
+                                          API_TRACE_MAX_CALLS[c],
+                                          (double)(API_TRACE_TOTAL_SECONDS[c] * 1000000.0f / (float)API_TRACE_TOTAL_CALLS[c]),
+                                          (double)(API_TRACE_TOTAL_SECONDS[c] * 1000.0f / (float)API_TRACE_FRAMES),
+                                          hist[0], hist[1], hist[2], hist[3], hist[4], hist[5], hist[6], hist[7]);
+        PD->file->write(file, line, length);
+        API_TRACE_REAL.system.realloc(line, 0);
     }
+    PD->file->write(file, "\n", 1);
+    PD->file->close(file);
     
-    for (i = 0; i < GRID_HEIGHT; i++)
+    PD->system->logToConsole("api trace: %.1f calls, %.2f ms per frame (%s)",
+                             (double)((float)calls / (float)API_TRACE_FRAMES),
+                             (double)(seconds * 1000.0f / (float)API_TRACE_FRAMES), API_TRACE_PATH);
+}
+
+// fold this frame's calls into the window's histograms
+static void endApiTraceFrame(void)
+{
+    for (int c = 0; c < ApiTraceCount; c++)
     {
-        for (int j = 0; j < GRID_WIDTH; j++)
+        int calls = API_TRACE_CALLS_THIS_FRAME[c];
+        int bin = 0;
+        while (bin < API_TRACE_BINS - 1 && (calls >> bin) != 0) bin++;
+        API_TRACE_HIST[c][bin]++;
+        if (calls > API_TRACE_MAX_CALLS[c]) API_TRACE_MAX_CALLS[c] = calls;
+        API_TRACE_TOTAL_CALLS[c] += calls;
+        API_TRACE_TOTAL_SECONDS[c] += API_TRACE_SECONDS_THIS_FRAME[c];
+    }
+    clearApiTraceFrame();
+    API_TRACE_FRAMES++;
+    if (API_TRACE_FRAMES < API_TRACE_WINDOW) return;
+    
+    writeApiTrace();
+    for (int c = 0; c < ApiTraceCount; c++)
+    {
+        for (int b = 0; b < API_TRACE_BINS; b++) API_TRACE_HIST[c][b] = 0;
+        API_TRACE_MAX_CALLS[c] = 0;
+        API_TRACE_TOTAL_CALLS[c] = 0;
+        API_TRACE_TOTAL_SECONDS[c] = 0.0f;
+    }
+    API_TRACE_FRAMES = 0;
+}
+#endif
+
+// everything that runs off the virtual clock
+static void stepSimulation(void)
+{
+    // node touches, pulses & deaths and pitch field changes
+    TOUCH_QUEUE_COUNT = 0;
+    advanceTimers();
+    touchNodes(TOUCH_QUEUE, TOUCH_QUEUE_COUNT);
+    
+    // (the sweep renders no audio for the governor to measure, & its stats are for the swept constants alone)
+#if !PARAM_SWEEP
+    if (CURRENT_TIME > NEXT_GOVERN)
+    {
+        governAudioLoad();
+        NEXT_GOVERN = CURRENT_TIME + GOVERN_RATE;
+    }
+#endif
+}
+
+#if SOAK_TEST || PARAM_SWEEP || BENCH_SUITE
+// a node of a random type at a random spot, drawn one at a time so the order doesn't rest on
+// how a compiler orders function arguments (same seed, same spawns on the simulator & the device)
+static void spawnRandomNode(void)
+{
+    enum NodeType type = takeRand() % 2 ? Strong : Weak;
+    int x = takeRand() % LCD_COLUMNS;
+    int y = takeRand() % LCD_ROWS;
+    makeNode(type, x, y);
+}
+#endif
+
+#if PARAM_SWEEP || BENCH_SUITE
+static void freeAllNodes(void)
+{
+    for (int i = 0; i < MAX_NODES; i++) { if (NODE_TYPE[i] != Dead) freeNode(i); }
+}
+#endif
+
+#if SOAK_TEST
+static void soakInputs(void)
+{
+    if (takeRand() % SOAK_SPAWN_ODDS == 0)
+    {
+        spawnRandomNode();
+    }
+    if (takeRand() % SOAK_CRANK_ODDS == 0) crankTimeVelocity((float)(takeRand() % 721 - 360));
+}
+
+// fail loudly on anything that would keep growing or has wandered off the clock
+static void checkSoak(float frameTime)
+{
+    int liveCount = 0;
+    for (int i = 0; i < MAX_NODES; i++)
+    {
+        if (NODE_TYPE[i] == Dead) continue;
+        liveCount++;
+        if (NODE_DEATH_TIME[i] < CURRENT_TIME || NODE_DEATH_TIME[i] > CURRENT_TIME + NODE_LIFETIME)
         {
-            GRID_POINT_NODE_COUNT[i][j] = 0;
+            PD->system->error("soak: node %d death time off the clock", i);
         }
-        
+        if (NODE_NEXT_PULSE[i] < CURRENT_TIME || NODE_NEXT_PULSE[i] - CURRENT_TIME > SOAK_HOUR)
+        {
+            PD->system->error("soak: node %d pulse time off the clock", i);
+        }
+    }
+    if (liveCount != LIVE_NODE_COUNT)
+    {
+        PD->system->error("soak: %d live nodes but LIVE_NODE_COUNT is %d", liveCount, LIVE_NODE_COUNT);
     }
     
-    // load images
-    PLAYER_BM = PD->graphics->loadBitmap("images/player", &ERR);
-    NODE_BMT_1[0] = PD->graphics->loadBitmap("images/Node_1/type_1_1", &ERR);
-    NODE_BMT_1[1] = PD->graphics->loadBitmap("images/Node_1/type_1_2", &ERR);
-    NODE_BMT_1[2] = PD->graphics->loadBitmap("images/Node_1/type_1_3", &ERR);
-    NODE_BMT_1[3] = PD->graphics->loadBitmap("images/Node_1/type_1_4", &ERR);
-    NODE_BMT_1[4] = PD->graphics->loadBitmap("images/Node_1/type_1_5", &ERR);
-    NODE_BMT_1[5] = PD->graphics->loadBitmap("images/Node_1/type_1_6", &ERR);
-    NODE_BMT_1[6] = PD->graphics->loadBitmap("images/Node_1/type_1_7", &ERR);
-    NODE_BMT_1[7] = PD->graphics->loadBitmap("images/Node_1/type_1_8", &ERR);
-    NODE_BMT_2[0] = PD->graphics->loadBitmap("images/Node_2/type_2_1", &ERR);
-    NODE_BMT_2[1] = PD->graphics->loadBitmap("images/Node_2/type_2_2", &ERR);
-    NODE_BMT_2[2] = PD->graphics->loadBitmap("images/Node_2/type_2_3", &ERR);
-    NODE_BMT_2[3] = PD->graphics->loadBitmap("images/Node_2/type_2_4", &ERR);
-    NODE_BMT_2[4] = PD->graphics->loadBitmap("images/Node_2/type_2_5", &ERR);
-    NODE_BMT_2[5] = PD->graphics->loadBitmap("images/Node_2/type_2_6", &ERR);
-    NODE_BMT_2[6] = PD->graphics->loadBitmap("images/Node_2/type_2_7", &ERR);
-    NODE_BMT_2[7] = PD->graphics->loadBitmap("images/Node_2/type_2_8", &ERR);
+    // the player plus one per node (and the water)
+    int spriteCount = PD->sprite->getSpriteCount();
+    if (spriteCount != LIVE_NODE_COUNT + 1 + WATER_FIELD)
+    {
+        PD->system->error("soak: %d sprites for %d nodes", spriteCount, LIVE_NODE_COUNT);
+    }
     
-    // make sprites
-    const struct playdate_sprite *sprite = PD->sprite;
-    PLAYER_SPRITE = sprite->newSprite();
-    sprite->setImage(PLAYER_SPRITE, PLAYER_BM, kBitmapUnflipped);
-    NODE_1_SPRITE_MASTER = sprite->newSprite();
-    sprite->setImage(NODE_1_SPRITE_MASTER, NODE_BMT_1[0], kBitmapUnflipped);
-    NODE_2_SPRITE_MASTER = sprite->newSprite();
-    sprite->setImage(NODE_2_SPRITE_MASTER, NODE_BMT_2[0], kBitmapUnflipped);
+    // every pool instrument is either free or held by one live node of its type
+    int pooled = 0;
+    for (int t = Strong; t < NodeTypeCount; t++) pooled += NODE_TYPE_INFO[t].poolSize - TYPE_POOL_FREE_COUNT[t];
+    if (pooled != LIVE_NODE_COUNT)
+    {
+        PD->system->error("soak: %d pool instruments out for %d nodes", pooled, LIVE_NODE_COUNT);
+    }
     
-    sprite->addSprite(PLAYER_SPRITE);
-    PLAYER_X = CENTER_X;
-    PLAYER_Y = CENTER_Y;
-    sprite->moveTo(PLAYER_SPRITE, PLAYER_X, PLAYER_Y);
+    // every node has a touch, pulse & death timer, plus the pitch field's
+    int timerCount = 0;
+    for (int i = 0; i < TIMER_COUNT; i++) { if (TIMER_SLOT[i] != -1) timerCount++; }
+    if (timerCount != LIVE_NODE_COUNT * NodeTimerCount + 1)
+    {
+        PD->system->error("soak: %d timers for %d nodes", timerCount, LIVE_NODE_COUNT);
+    }
     
-    // add global effects
-    const struct playdate_sound *pdSound = PD->sound;
-    CHANNEL = pdSound->channel->newChannel();
+    if (SOAK_MISTIMED > 0)
+    {
+        PD->system->error("soak: %d timers fired off their due time", SOAK_MISTIMED);
+    }
     
-    HIGH_SHELF = pdSound->effect->twopolefilter->newFilter();
-    PD->sound->effect->twopolefilter->setType(HIGH_SHELF, kFilterTypeHighShelf);
-    PD->sound->effect->twopolefilter->setFrequency(HIGH_SHELF, 800.0f);
-    PD->sound->effect->twopolefilter->setResonance(HIGH_SHELF, 1.0f);
-    PD->sound->effect->twopolefilter->setGain(HIGH_SHELF, lerp(-1.0f * MIN_HIGHS, MAX_HIGHS, 0.5f));
-    pdSound->channel->addEffect(CHANNEL, (SoundEffect *)HIGH_SHELF);
+    if (frameTime > SOAK_WORST_FRAME) SOAK_WORST_FRAME = frameTime;
+    if (LIVE_NODE_COUNT > SOAK_PEAK_NODES) SOAK_PEAK_NODES = LIVE_NODE_COUNT;
     
-    LOW_SHELF = pdSound->effect->twopolefilter->newFilter();
-    PD->sound->effect->twopolefilter->setType(LOW_SHELF, kFilterTypeLowShelf);
-    PD->sound->effect->twopolefilter->setFrequency(LOW_SHELF, 300.0f);
-    PD->sound->effect->twopolefilter->setResonance(LOW_SHELF, 1.0f);
-    PD->sound->effect->twopolefilter->setGain(LOW_SHELF, lerp(-1.0f * MIN_LOWS, MAX_LOWS, 0.5f));
-    pdSound->channel->addEffect(CHANNEL, (SoundEffect *)LOW_SHELF);
+    int hours = (int)((CURRENT_TIME - SOAK_START_TIME) / SOAK_HOUR);
+    if (hours == SOAK_HOURS_DONE) return;
+    SOAK_HOURS_DONE = hours;
+    PD->system->logToConsole("soak %dh: peak nodes %d, cap %d, worst frame %.1f ms, queue drops %d",
+                             hours, SOAK_PEAK_NODES, NODE_CAP, (double)(SOAK_WORST_FRAME * 1000.0f), AUDIO_QUEUE_DROPS);
+    SOAK_WORST_FRAME = 0.0f;
+    SOAK_PEAK_NODES = 0;
+    if (hours >= SOAK_HOURS) PD->system->logToConsole("soak passed");
+}
+
+static void runSoak(void)
+{
+    if (SOAK_HOURS_DONE >= SOAK_HOURS) return;
     
-    /*
-    DELAY = pdSound->effect->delayline->newDelayLine(SAMPLE_RATE, 1);
-    pdSound->effect->delayline->setFeedback(DELAY, 0.9f);
-    pdSound->effect->delayline->setLength(DELAY, 35);
-    DELAY_OUT = pdSound->effect->delayline->addTap(DELAY, 0);
-    pdSound->source->setVolume((SoundSource *)DELAY_OUT, 1.0f, 1.0f);
-    pdSound->channel->addSource(CHANNEL, (SoundSource *)DELAY_OUT);
-     */
+    PD->system->resetElapsedTime();
+    for (int step = 0; step < SOAK_STEPS_PER_FRAME; step++)
+    {
+        CURRENT_TIME += SOAK_STEP;
+        soakInputs();
+        stepSimulation();
+#if REWIND
+        // the rewind ring gets soaked along with everything else
+        recordRewind();
+#endif
+    }
+    checkSoak(PD->system->getElapsedTime());
+}
+#endif
+
+#if PARAM_SWEEP
+// clear the field & set the tunables for SWEEP_COMBO
+static void startSweepCombo(void)
+{
+    freeAllNodes();
     
-    PITCH_FIELD_ID = 0;
-    PITCH_FIELD = PITCH_FIELD_SET[PITCH_FIELD_ID];
-    NEXT_PITCH_FIELD_CHANGE = CURRENT_TIME + CHANGE_PITCH_FIELD_RATE;
+    int combo = SWEEP_COMBO;
+    NODE_LIFETIME = SAMPLE_RATE * SWEEP_LIFETIME_SECONDS[combo % SWEEP_VALUES];
+    combo /= SWEEP_VALUES;
+    PULSE_MOD_SCALE = SWEEP_PULSE_SCALE[combo % SWEEP_VALUES];
+    combo /= SWEEP_VALUES;
+    RARE_PITCH_ODDS = SWEEP_RARE_ODDS[combo % SWEEP_VALUES];
+    combo /= SWEEP_VALUES;
+    CHANGE_PITCH_FIELD_RATE = SAMPLE_RATE * SWEEP_PITCH_FIELD_SECONDS[combo % SWEEP_VALUES];
+    scheduleTimer(PITCH_FIELD_TIMER, CURRENT_TIME + CHANGE_PITCH_FIELD_RATE);
+    // & nothing carried over from the combination before
+    NODE_CAP = MAX_NODES;
+    LIFETIME_SCALE = 1.0f;
+    NEXT_GOVERN = CURRENT_TIME + GOVERN_RATE;
+    
+    // same spawn stream for every combination
+    seedTake(TAKE_SEED);
+    SWEEP_STEPS = 0;
+    SWEEP_NOTES = 0;
+    for (int i = 0; i < 12; i++) SWEEP_PITCH_CLASS[i] = 0;
+    SWEEP_VOICE_SUM = 0;
+    SWEEP_PEAK_VOICES = 0;
+    SWEEP_PEAK_NODES = 0;
 }
 
-#ifdef _WINDLL
-__declspec(dllexport)
-#endif
-int eventHandler(PlaydateAPI* pd, PDSystemEvent event, uint32_t arg)
+static void finishSweepCombo(void)
 {
-    (void)arg; // arg is currently only used for event = kEventKeyPressed
+    float seconds = (float)SWEEP_STEPS * (float)SWEEP_STEP / (float)SAMPLE_RATE;
+    int notes = SWEEP_NOTES > 0 ? SWEEP_NOTES : 1;
+    int *pc = SWEEP_PITCH_CLASS;
+    PD->system->logToConsole("sweep lifetime %ds pulse x%.1f rare %d field %ds: %.2f notes/s, polyphony %.2f avg %d peak, peak nodes %d",
+                             NODE_LIFETIME / SAMPLE_RATE, (double)PULSE_MOD_SCALE, RARE_PITCH_ODDS, CHANGE_PITCH_FIELD_RATE / SAMPLE_RATE,
+                             (double)((float)SWEEP_NOTES / seconds),
+                             (double)((float)SWEEP_VOICE_SUM / (float)SWEEP_STEPS), SWEEP_PEAK_VOICES, SWEEP_PEAK_NODES);
+    PD->system->logToConsole("  pitch classes %%: %d %d %d %d %d %d %d %d %d %d %d %d",
+                             pc[0] * 100 / notes, pc[1] * 100 / notes, pc[2] * 100 / notes, pc[3] * 100 / notes,
+                             pc[4] * 100 / notes, pc[5] * 100 / notes, pc[6] * 100 / notes, pc[7] * 100 / notes,
+                             pc[8] * 100 / notes, pc[9] * 100 / notes, pc[10] * 100 / notes, pc[11] * 100 / notes);
+}
 
-    if ( event == kEventInit )
+static void runSweep(void)
+{
+    if (SWEEP_COMBO >= SWEEP_COMBOS) return;
+    if (SWEEP_STARTED_MS == 0)
     {
-        setup(pd);
-        
-        // get outta here, lua
-        pd->system->setUpdateCallback(update, pd);
+        SWEEP_STARTED_MS = PD->system->getCurrentTimeMilliseconds();
+        startSweepCombo();
     }
     
-    return 0;
+    const int comboSteps = SWEEP_MINUTES * 60 * SAMPLE_RATE / SWEEP_STEP;
+    for (int step = 0; step < SWEEP_STEPS_PER_FRAME; step++)
+    {
+        CURRENT_TIME += SWEEP_STEP;
+        if (takeRand() % SWEEP_SPAWN_ODDS == 0)
+        {
+            spawnRandomNode();
+        }
+        stepSimulation();
+        
+        int voices = 0;
+        for (int i = 0; i < MAX_NODES; i++) { if (NODE_TYPE[i] != Dead && NODE_SOUNDING_UNTIL[i] > CURRENT_TIME) voices++; }
+        SWEEP_VOICE_SUM += voices;
+        if (voices > SWEEP_PEAK_VOICES) SWEEP_PEAK_VOICES = voices;
+        if (LIVE_NODE_COUNT > SWEEP_PEAK_NODES) SWEEP_PEAK_NODES = LIVE_NODE_COUNT;
+        
+        if (++SWEEP_STEPS < comboSteps) continue;
+        finishSweepCombo();
+        if (++SWEEP_COMBO == SWEEP_COMBOS)
+        {
+            PD->system->logToConsole("sweep: %d combinations in %.1f s", SWEEP_COMBOS,
+                                     (double)((float)(PD->system->getCurrentTimeMilliseconds() - SWEEP_STARTED_MS) / 1000.0f));
+            return;
+        }
+        startSweepCombo();
+    }
 }
+#endif
 
-static void processInputs(void)
+#if BENCH_SUITE
+static void startBenchScenario(void)
 {
-    PDButtons current;
-    PDButtons pushed;
-    PD->system->getButtonState(&current, &pushed, NULL);
+    freeAllNodes();
+    crankTimeVelocity((1.0f - TIME_VELOCITY) * 720.0f);
+    BENCH_CRANK_DIRECTION = 1.0f;
+    seedTake(TAKE_SEED);
     
-    if (current & kButtonUp) PLAYER_Y -= 3.0f;
-    if (current & kButtonDown) PLAYER_Y += 3.0f;
-    if (current & kButtonLeft) PLAYER_X -= 3.0f;
-    if (current & kButtonRight) PLAYER_X += 3.0f;
+    if (BENCH_SCENARIO == BenchFull)
+    {
+        for (int i = 0; i < MAX_NODES; i++) spawnRandomNode();
+    }
     
-    if (PLAYER_X > (float)LCD_COLUMNS) PLAYER_X -= (float)LCD_COLUMNS;
-    if (PLAYER_Y > (float)LCD_ROWS) PLAYER_Y -= (float)LCD_ROWS;
-    if (PLAYER_X < 0.0f) PLAYER_X += (float)LCD_COLUMNS;
-    if (PLAYER_Y < 0.0f) PLAYER_Y += (float)LCD_ROWS;
+    BENCH_FRAME = 0;
+    BENCH_FRAME_SECONDS = 0.0f;
+    BENCH_WORST_FRAME = 0.0f;
+    BENCH_CONTROL_SECONDS = 0.0f;
+    BENCH_API_CALLS = 0;
+}
+
+// drive the current scenario & step the simulation, timing both as the control tick
+static void runBenchFrame(void)
+{
+    if (BENCH_FRAME < 0 || BENCH_SCENARIO >= BenchScenarioCount) return;
     
-    PD->sprite->moveTo(PLAYER_SPRITE, PLAYER_X, PLAYER_Y);
+    float before = PD->system->getElapsedTime();
+    CURRENT_TIME += (uint64_t)((float)BENCH_FRAME_SAMPLES * TIME_VELOCITY);
     
-    if (pushed & kButtonA) { makeNode(Strong, PLAYER_X, PLAYER_Y); }
-    else if (pushed & kButtonB) { makeNode(Weak, PLAYER_X, PLAYER_Y); }
+    switch (BENCH_SCENARIO)
+    {
+        case BenchFull:
+            while (LIVE_NODE_COUNT < NODE_CAP - 1) spawnRandomNode();
+            break;
+        case BenchStorm:
+            for (int n = 0; n < BENCH_STORM_NODES; n++)
+            {
+                // the next live node from a random slot
+                int start = takeRand() % MAX_NODES;
+                for (int i = 0; i < MAX_NODES; i++)
+                {
+                    int nodeID = (start + i) % MAX_NODES;
+                    if (NODE_TYPE[nodeID] == Dead) continue;
+                    freeNode(nodeID);
+                    break;
+                }
+                spawnRandomNode();
+            }
+            break;
+        case BenchCrank:
+            if (TIME_VELOCITY >= MAX_TIME_VELOCITY) BENCH_CRANK_DIRECTION = -1.0f;
+            if (TIME_VELOCITY <= MIN_TIME_VELOCITY) BENCH_CRANK_DIRECTION = 1.0f;
+            crankTimeVelocity(BENCH_CRANK_DIRECTION * BENCH_CRANK_DEGREES);
+            if (takeRand() % BENCH_SPAWN_ODDS == 0) spawnRandomNode();
+            break;
+        case BenchPitchFields:
+            // fired from the timer wheel like any other change
+            if (BENCH_FRAME % BENCH_PITCH_FIELD_FRAMES == 0) scheduleTimer(PITCH_FIELD_TIMER, CURRENT_TIME);
+            if (takeRand() % BENCH_SPAWN_ODDS == 0) spawnRandomNode();
+            break;
+        case BenchSoak:
+            if (takeRand() % BENCH_SPAWN_ODDS == 0) spawnRandomNode();
+            break;
+        default:
+            break;
+    }
     
-    if (PD->system->isCrankDocked() == 0)
+    stepSimulation();
+#if REWIND
+    recordRewind();
+#endif
+    BENCH_CONTROL_SECONDS += PD->system->getElapsedTime() - before;
+}
+
+static void writeBenchResults(void)
+{
+    SDFile *file = PD->file->open(BENCH_RESULTS_PATH, kFileWrite);
+    if (file == NULL)
     {
-        float change = PD->system->getCrankChange();
-        if (change != 0.0f && TIME_VELOCITY < MAX_TIME_VELOCITY + 1 && TIME_VELOCITY > MIN_TIME_VELOCITY - 1)
+        PD->system->logToConsole("bench: couldn't open %s: %s", BENCH_RESULTS_PATH, PD->file->geterr());
+        return;
+    }
+    for (int s = 0; s < BenchScenarioCount; s++)
+    {
+        const float *r = BENCH_RESULTS[s];
+        char *line;
+        int length = PD->system->formatString(&line, "%s %.3f %.3f %.3f %.2f\n", BENCH_SCENARIOS[s].name,
+                                              (double)r[BenchFrameMs], (double)r[BenchWorstFrameMs], (double)r[BenchControlMs],
+                                              (double)r[BenchApiCalls]);
+        PD->file->write(file, line, length);
+        PD->system->realloc(line, 0);
+    }
+    PD->file->close(file);
+}
+
+// check the results against the baseline (in the data folder or bundled from Source/), fail on regressions
+static void compareBenchBaseline(void)
+{
+    SDFile *file = PD->file->open(BENCH_BASELINE_PATH, kFileRead | kFileReadData);
+    if (file == NULL)
+    {
+        PD->system->error("bench: no %s, copy %s into Source/ to make it the baseline", BENCH_BASELINE_PATH, BENCH_RESULTS_PATH);
+        return;
+    }
+    char text[1024];
+    int length = PD->file->read(file, text, sizeof(text) - 1);
+    PD->file->close(file);
+    if (length < 0) length = 0;
+    text[length] = '\0';
+    
+    int regressions = 0;
+    int compared[BenchScenarioCount] = { 0 };
+    char *token = strtok(text, " \n");
+    while (token != NULL)
+    {
+        int s = 0;
+        while (s < BenchScenarioCount && strcmp(BENCH_SCENARIOS[s].name, token) != 0) s++;
+        if (s < BenchScenarioCount) compared[s] = 1;
+        for (int m = 0; m < BenchMetricCount; m++)
         {
-            // adjust time velocity
-            TIME_VELOCITY += change / 720.0f;
-            if (TIME_VELOCITY > MAX_TIME_VELOCITY) TIME_VELOCITY = MAX_TIME_VELOCITY;
-            if (TIME_VELOCITY < MIN_TIME_VELOCITY) TIME_VELOCITY = MIN_TIME_VELOCITY;
-            
-            // TODO adjust filters
-            float filterAlpha = TIME_VELOCITY/MAX_TIME_VELOCITY;
-            PD->sound->effect->twopolefilter->setGain(
-                                                      HIGH_SHELF,
-                                                      lerp(-1.0f * MIN_HIGHS, MAX_HIGHS, filterAlpha)
-                                                      );
-            PD->sound->effect->twopolefilter->setGain(
-                                                      LOW_SHELF,
-                                                      lerp(-1.0f * MIN_LOWS, MAX_LOWS, 1.0f - filterAlpha)
-                                                      );
-            
-            // TODO adjust visuals
+            token = strtok(NULL, " \n");
+            if (token == NULL || s == BenchScenarioCount || BENCH_METRIC_SLACK[m] < 0.0f) continue;
+            float baseline = strtof(token, NULL);
+            float result = BENCH_RESULTS[s][m];
+            if (result <= baseline * (1.0f + BENCH_THRESHOLD) + BENCH_METRIC_SLACK[m]) continue;
+            PD->system->logToConsole("bench: %s %s regressed, %.3f against %.3f", BENCH_SCENARIOS[s].name,
+                                     BENCH_METRIC_NAMES[m], (double)result, (double)baseline);
+            regressions++;
         }
+        token = strtok(NULL, " \n");
+    }
+    // a scenario the baseline doesn't cover can't have passed
+    for (int s = 0; s < BenchScenarioCount; s++)
+    {
+        if (compared[s]) continue;
+        PD->system->logToConsole("bench: %s has no %s line", BENCH_BASELINE_PATH, BENCH_SCENARIOS[s].name);
+        regressions++;
+    }
+    
+    if (regressions > 0) PD->system->error("bench: %d regressions or missing scenarios against %s", regressions, BENCH_BASELINE_PATH);
+    else PD->system->logToConsole("bench passed");
+}
+
+// close a frame of the current scenario, moving on to the next when it's done
+static void endBenchFrame(float frameSeconds)
+{
+    if (BENCH_SCENARIO >= BenchScenarioCount) return;
+    if (BENCH_FRAME < 0)
+    {
+        startBenchScenario();
+        return;
+    }
+    
+    BENCH_FRAME_SECONDS += frameSeconds;
+    if (frameSeconds > BENCH_WORST_FRAME) BENCH_WORST_FRAME = frameSeconds;
+    for (int c = 0; c < ApiTraceCount; c++) BENCH_API_CALLS += API_TRACE_CALLS_THIS_FRAME[c];
+    if (++BENCH_FRAME < BENCH_SCENARIOS[BENCH_SCENARIO].frames) return;
+    
+    float frames = (float)BENCH_FRAME;
+    float *r = BENCH_RESULTS[BENCH_SCENARIO];
+    r[BenchFrameMs] = BENCH_FRAME_SECONDS * 1000.0f / frames;
+    r[BenchWorstFrameMs] = BENCH_WORST_FRAME * 1000.0f;
+    r[BenchControlMs] = BENCH_CONTROL_SECONDS * 1000.0f / frames;
+    r[BenchApiCalls] = (float)BENCH_API_CALLS / frames;
+    PD->system->logToConsole("bench %s: frame %.2f ms (worst %.2f), control %.2f ms, %.1f api calls per frame",
+                             BENCH_SCENARIOS[BENCH_SCENARIO].name, (double)r[BenchFrameMs], (double)r[BenchWorstFrameMs],
+                             (double)r[BenchControlMs], (double)r[BenchApiCalls]);
+    
+    if (++BENCH_SCENARIO < BenchScenarioCount)
+    {
+        startBenchScenario();
+        return;
     }
+    writeBenchResults();
+    compareBenchBaseline();
 }
+#endif
 
 static int update(void* userdata)
 {
     // grab globals
     PD = (PlaydateAPI *)userdata;
+#if FRAME_STATS
+    PD->system->resetElapsedTime();
+#endif
+#if BENCH_SUITE
+    float frameStart = PD->system->getElapsedTime();
+#endif
     uint32_t newRealTime = PD->sound->getCurrentTime();
-    CURRENT_TIME += floorf((float)(newRealTime - LAST_REAL_TIME) * TIME_VELOCITY);
-    LAST_REAL_TIME = newRealTime;
     
-    processInputs();
+#if AUDIO_STATS
+    // wall time in samples, which keeps going when the render falls behind
+    checkAudioDeadlines((uint32_t)((uint64_t)PD->system->getCurrentTimeMilliseconds() * SAMPLE_RATE / 1000));
+#endif
     
-    if (CURRENT_TIME > NEXT_TOUCH)
+#if SOAK_TEST
+    processInputs();
+    runSoak();
+#elif PARAM_SWEEP
+    processInputs();
+    runSweep();
+#elif BENCH_SUITE
+    processInputs();
+    runBenchFrame();
+#else
+#if REWIND
+    // the clock stands still while scrubbing
+    if (REWINDING) processInputs();
+    else
+#endif
     {
-        // touch and pulse all live nodes
-        for (int i = 0; i < MAX_NODES; i++) { if (NODE_TYPE[i] != Dead) touchNode(i); }
-        NEXT_TOUCH = CURRENT_TIME + TOUCH_RATE;
+        // advance the virtual clock, carrying the fractional samples so it doesn't drift
+        float advance = (float)(newRealTime - LAST_REAL_TIME) * TIME_VELOCITY + CURRENT_TIME_REMAINDER;
+        uint32_t wholeSamples = (uint32_t)advance;
+        CURRENT_TIME_REMAINDER = advance - (float)wholeSamples;
+        CURRENT_TIME += wholeSamples;
+        
+        processInputs();
+#if REWIND
+        // the crank may have just started a rewind
+        if (!REWINDING)
+        {
+            stepSimulation();
+            recordRewind();
+        }
+#else
+        stepSimulation();
+#endif
     }
+#endif
+    LAST_REAL_TIME = newRealTime;
     
-    if (CURRENT_TIME > NEXT_PITCH_FIELD_CHANGE)
-    {
-        PITCH_FIELD_ID = (PITCH_FIELD_ID + 1) % 4;
-        PITCH_FIELD = PITCH_FIELD_SET[PITCH_FIELD_ID];
-        NEXT_PITCH_FIELD_CHANGE = CURRENT_TIME + CHANGE_PITCH_FIELD_RATE;
-    }
+    animateNodes();
     
     // draw stuff
     
+    eraseRipples();
+#if WATER_FIELD
+    stepWater();
+    markWater();
+#endif
     PD->sprite->updateAndDrawSprites();
+    drawRipples();
+    
+#if MIDI_EXPORT
+    if (MIDI_BUFFER_USED >= MIDI_FLUSH_SIZE) flushMidi();
+#endif
+#if WAV_CAPTURE
+    if (WAV_FILE != NULL) updateWavCapture();
+#endif
     
     if (ERR != NULL) PD->system->logToConsole("Error: %s", ERR);
+    
+#if FRAME_STATS
+    recordFrameTime(PD->system->getElapsedTime());
+#endif
+#if BENCH_SUITE
+    endBenchFrame(PD->system->getElapsedTime() - frameStart);
+#endif
+#if API_TRACE
+    endApiTraceFrame();
+#endif
 
     return 1;
 }